@@ -28,6 +28,9 @@
   | #define CPROGRESS_IMPL
   | #include "cprogress.h"
 
+  From C++, cprogress.hpp wraps instances and tasks in owning types, see
+  there.
+
   Define macros below GLOBALLY to tune behaviours
 
   #define CPROGRESS_CONFIG_NOPLATFORM
@@ -35,6 +38,13 @@
     functions on any platforms, but will lose the ability to render directly
     without manually setting console width.
 
+  #define CPROGRESS_MALLOC(size), CPROGRESS_REALLOC(ptr, size), CPROGRESS_FREE(ptr)
+    Replace the allocator, only needed where the implementation is included.
+
+  #define CPROGRESS_CONFIG_STATS
+    Count what the library does, see cprogress_getstats(...). Without it
+    every counter is compiled out.
+
 
   USAGE
   =====
@@ -104,7 +114,11 @@
 
   [title] will be duplicated so it's safe to free it after calling.
 
-  Updaters can be called from anywhere e.g. any thread.
+  Updaters can be called from anywhere e.g. any thread. So can
+  cprogress_starttask(...) and cprogress_aborttask(...): a task only starts
+  when it isn't running and only stops once, so CPROGRESS_EVENT_THREADSTART
+  and CPROGRESS_EVENT_THREADSTOP come exactly once each per run of a task.
+  See cprogress_taskstate_t for the whole lifecycle.
 
   Then in your main thread, you can write in the form of:
 
@@ -124,6 +138,107 @@
   cprogress_wait*(...) must be called at the end of loop in order to clean the
   internal temporary state.
 
+  Frames are only drawn when something visible changed. An update that
+  neither moves the bar by a cell nor changes the digits shown only stores
+  the number, so updating a million times a second costs no more frames
+  than there are steps to see. Formats with things that change by
+  themselves, like "state" styles, are redrawn every
+  CPROGRESS_RENDER_REPAINT_MS anyway, custom conversions every frame.
+
+
+  DYNAMIC TASKS
+  =============
+
+  When the work is discovered on the way, instead of creating with a large
+  enough [task_count]:
+
+  | cprogress_taskhandle_t task = cprogress_task_acquire(cprogress: cprogress_t *);
+  | cprogress_task_start(task);
+  | cprogress_task_updatepercentage(task, percentage: float);
+  | cprogress_task_release(task);
+
+  Slots are taken from a free list and the table grows as needed, both
+  without locks. Every release invalidates the handle, so calls through a
+  stale one are ignored, even if the slot has been acquired again. Such
+  tasks are rendered and counted like the others, but are only reachable by
+  handle, and are not shared (see SHARING). Their index, as given to event
+  subscribers, is [task.index]. cprogress_gettaskinfo(...) only reaches the
+  fixed tasks, to look up any index:
+
+  | cprogress_taskinfo_t *cprogress_findtaskinfo(cprogress: cprogress_t *, task_index: int);
+
+  which is NULL for an index no task has.
+
+
+  PARALLEL LOOPS
+  ==============
+
+  Rather than starting threads that each report their own percentage:
+
+  | cprogress_parallel_for(cprogress: cprogress_t *, begin: long, end: long,
+  |   grain: long, func, ctx: void *);
+
+  calls func(chunk_begin, chunk_end, worker_index, ctx) for every [grain]
+  items of [begin, end) on a pool of workers, one per core, and returns once
+  all are done. A zero [grain] splits the range in 16 chunks per worker.
+  Each worker starts with an even share of the chunks in a deque of its
+  own, and once through, steals from the others' far ends, so uneven
+  chunks even out.
+
+  Progress shows up as a task of its own, acquired for the run (see
+  DYNAMIC TASKS). Workers only count what they did, each in a counter of
+  their own, once per chunk. At most CPROGRESS_PARALLEL_FPS times a
+  second, the first worker through a chunk past the deadline adds them up
+  into the task and renders, one at a time, so a long chunk doesn't hold
+  the frames back. The calling thread is worker 0. To tune it:
+
+  | cprogress_setparallel(cprogress: cprogress_t *, worker_count: int, flags: int);
+
+  A zero [worker_count] is one per core. [flags] is a bitwise or of:
+    CPROGRESS_PARALLEL_WORKERROWS: a row per worker too, showing its part
+    CPROGRESS_PARALLEL_NORENDER: only updates the tasks, for instances
+      rendered by another thread
+
+
+  FILES
+  =====
+
+  Copying a file descriptor into another reports as it goes:
+
+  | int64_t cprogress_copy_fd(cprogress: cprogress_t *, task_index: int,
+  |   in_fd: int, out_fd: int, length: int64_t);
+
+  moves [length] bytes, or everything till the end with a negative one,
+  from where [in_fd] is at to where [out_fd] is at, both blocking, and
+  returns how many, or -1 with errno set, the task left where it was. The
+  task is updated once every CPROGRESS_IO_CHUNKSIZE bytes, and set to 100
+  at the end. Percentages need a [length], or [in_fd] to be a regular file.
+
+  The bytes stay in the kernel as long as it can: copy_file_range(2),
+  which may share the blocks on filesystems that can, then sendfile(2)
+  from files to anything, then splice(2) to or from pipes. Whatever none
+  of them takes goes through a buffer of CPROGRESS_IO_BUFSIZE bytes
+  aligned to CPROGRESS_IO_BUFALIGN.
+
+  | int64_t cprogress_copy_fdcounted(cprogress: cprogress_t *, task_index: int,
+  |   in_fd: int, out_fd: int, length: int64_t, counted: int64_t *);
+
+  is the same, with each move added to [counted] as it goes, atomically, for
+  another thread to read bytes and rates between two updates of the task.
+
+  To read it yourself instead:
+
+  | cprogress_reader_t reader;
+  | cprogress_reader_open(&reader, &cprogress, task_index, fd);
+  | while ((n = cprogress_reader_read(&reader, buf, sizeof(buf))) > 0) ...
+
+  Reads are read(2) retried on EINTR, reported the same way. A regular file
+  is hinted sequential, and CPROGRESS_IO_READAHEAD bytes ahead of the
+  reader are asked for before it gets there. Both need POSIX, elsewhere
+  they fail, with CPROGRESS_ERROR_UNSUPPORTED or -1.
+
+  See cprogress-pv for a pipe viewer, with rows of bytes, rates and ETAs.
+
 
   FORMAT
   ======
@@ -142,6 +257,9 @@
       In this case, arg1 is made use of displaying the progress that is done
       and width is a necessary arg.
     p: prints percentage, in float
+    s: a sparkline of the recent progress, newest on the right, see HISTORY
+      Like b, width is a necessary arg.
+    {...}: styles what follows, see STYLES
   while for [width]:
     - when as an integer: limits length and pad tailing spaces when not
       satisfied
@@ -198,6 +316,287 @@
   |   return 0;
   | }
 
+
+  CONVERSIONS
+  ===========
+
+  More conversions, like a queue depth or a shard id, are registered once
+  for the process, before the instances using them are created:
+
+  | cprogress_registerconversion(conversion: char, func: cprogress_conversion_func_t *, userdata: void *,
+  |   width_type: cprogress_conversion_widthtype_t, width: size_t);
+
+  [conversion] is any letter not taken by the ones above, a NULL [func]
+  takes it back. [func] writes at most [alloc_width] columns into [buf],
+  and returns how many bytes it wrote, [taskinfo] is NULL when the line
+  isn't a task's. Lines are laid out without asking [func] twice, so it
+  declares how wide it gets:
+
+  | CPROGRESS_CONVERSION_FIXEDWIDTH   always [width] columns, it's only
+  |                                   called to draw
+  | CPROGRESS_CONVERSION_MAXWIDTH     up to [width] columns, it's called to
+  |                                   draw aside, the auto spanned element
+  |                                   gets what is left
+
+  A width in the format, or "=", overrides [width]. Whatever is short is
+  padded. Viewers of a shared instance (see SHARING) have to register the
+  same conversions.
+
+
+  STYLES
+  ======
+
+  "${...}" styles everything after it till the next one, "${}" goes back to
+  none. Inside, any of these separated by commas:
+
+  | bold, dim, italic, underline
+  | black, red, green, yellow, blue, magenta, cyan, white, or bright ones
+  |   like brightred
+  | state   green once done, red if aborted or stalled for
+  |         CPROGRESS_STYLE_STALL_MS, the other color otherwise
+
+  | ${dim}[${state}$40b#${dim}]${} $p%
+
+  Only what changes between two neighbouring elements is sent, and each
+  line ends unstyled. Colors are dropped when NO_COLOR is set, all of them
+  when stdout is not a terminal, see TERMINALS, lines are then composed as
+  if there were none.
+
+
+  SHARING
+  =======
+
+  Instead of drawing by itself, an instance can mirror its tasks into a
+  shared memory region, so that the job does no terminal I/O at all and any
+  number of viewers (see cprogress-top) can attach and detach from any shell.
+  Linux only for now.
+
+  | cprogress_share(cprogress: cprogress_t *, name: string);
+
+  [name] identifies the region, e.g. "myjob", and is passed to shm_open(3).
+  Returns zero on success, CPROGRESS_ERROR_INVAL if a live job already shares
+  under [name]. A region left behind by a job that died is taken over, or
+  CPROGRESS_SHARED_GRACE seconds after it was created if the job died while
+  sharing it. Then, in place of the render loop:
+
+  | cprogress_share_tillcomplete(cprogress: cprogress_t *, fps: int);
+
+  To keep rendering to the terminal as well, call
+  cprogress_share_publish(cprogress: cprogress_t *) between
+  cprogress_beginrender(...) and cprogress_endrender(...) instead.
+
+  The region is removed by cprogress_unshare(...) or cprogress_destroy(...).
+  Viewers map it read-only with cprogress_share_attach(...) and copy it into
+  an instance of their own with cprogress_share_read(...), which can then be
+  rendered as usual.
+
+
+  INGEST
+  ======
+
+  Reporters living in other processes, whatever language they are written
+  in, can feed an instance through a unix domain socket:
+
+  | cprogress_ingest_listen(cprogress: cprogress_t *, path: string);
+
+  Returns zero on success. Once listening, cprogress_wait*(...) serves
+  reporters while waiting, or call cprogress_ingest_poll(...) from your own
+  loop. Reporters connect to [path] and write one update per line:
+
+  | 3 42.5        set task 3 to 42.5%
+  | 3 +0.25       add 0.25% to task 3
+  | 3 s           start task 3
+  | 3 a           abort task 3
+  | 3 t Copying   set the title of task 3
+
+  Updates go through cprogress_updatetask_*(...) like local ones. Invalid
+  lines are skipped and counted in [cprogress.ingest->rejected_count].
+  See cprogress-loadgen for a reporter that measures throughput.
+
+
+  EVENT LOOPS
+  ===========
+
+  Instead of waiting in cprogress_waitfps(...), a loop of your own can
+  render whenever it comes around:
+
+  | int64_t cprogress_tick(cprogress: cprogress_t *, fps: int);
+
+  It draws at most one frame, and only if one is due, then returns the
+  cprogress_nanotime() by which it wants to be called again. Frames are
+  due at [fps] while something changes, and a lot less often otherwise.
+  On Linux, rather than computing timeouts, have it wake the loop:
+
+  | cprogress_tick_open(&cprogress);
+  | epoll_ctl(loop_fd, EPOLL_CTL_ADD, cprogress.tick->epoll_fd, &event);
+  | ...
+  | // when cprogress.tick->epoll_fd is readable
+  | cprogress_tick(&cprogress, 30);
+  | if (!cprogress_stillrunning(&cprogress)) ... // stop watching it
+
+  The fd is an epoll one of its own holding a timerfd, armed by
+  cprogress_tick(...) for the next frame, and an eventfd, written when an
+  update makes a clean frame dirty, i.e. once per frame at most. Polled
+  from io_uring it works the same. Like cprogress_destroy(...), which
+  closes it too, cprogress_tick_close(...) has to wait for workers to stop
+  updating. Elsewhere cprogress_tick_open(...) returns
+  CPROGRESS_ERROR_UNSUPPORTED.
+
+
+  EVENTS
+  ======
+
+  | cprogress_subscribeevent(cprogress: cprogress_t *, type: cprogress_event_type_t, func);
+
+  Up to CPROGRESS_EVENT_MAXSUBSCRIBERS functions can subscribe to each type,
+  and are called in the order they subscribed. By default they are called
+  right away on the thread that caused the event, e.g. the worker whose
+  cprogress_updatetask_percentage(...) reached 100%. To keep slow
+  subscribers off your workers:
+
+  | cprogress_deferevents(cprogress: cprogress_t *, queue_length: size_t,
+  |   policy: cprogress_eventpolicy_t);
+
+  Events are then queued and delivered in order by cprogress_endrender(...)
+  on the render thread, or by cprogress_flushevents(...), and never on the
+  thread that caused them, unless it is the one delivering them.
+  CPROGRESS_EVENT_STOP is always delivered after everything queued before
+  it. When the queue is full, [policy] decides:
+
+  | CPROGRESS_EVENTS_DROP    the event is lost and counted in [events_dropped_count]
+  | CPROGRESS_EVENTS_BLOCK   the caller waits for the next frame
+
+  The thread delivering them, the last one to flush, or else the one that
+  called cprogress_deferevents(...), empties a full queue itself rather
+  than waiting on it. With CPROGRESS_EVENTS_BLOCK, keep rendering, or
+  flushing, till the workers are joined.
+
+
+  LOGGING
+  =======
+
+  Printing while bars are drawn tears them apart. Instead:
+
+  | cprogress_openlog(cprogress: cprogress_t *, queue_length: size_t, policy: cprogress_logpolicy_t);
+  | cprogress_log(cprogress: cprogress_t *, fmt: string, ...);
+
+  cprogress_log(...) formats on the calling thread and queues the line
+  without taking any lock; the next frame writes all queued lines above the
+  bars, within the same write. Lines longer than CPROGRESS_LOG_LINEMAXLEN
+  are cut. When the queue is full, [policy] decides:
+
+  | CPROGRESS_LOG_DROP    the line is lost and counted in [log_dropped_count]
+  | CPROGRESS_LOG_BLOCK   the caller waits for the next frame
+
+  The thread draining it, the one rendering, or else the one that called
+  cprogress_openlog(...), writes a full queue out itself rather than
+  waiting on it, and drops the line when in the middle of a frame.
+  Without cprogress_openlog(...), lines are printed right away like
+  cprogress_logf(...) does.
+
+
+  DISPLAY POLICIES
+  ================
+
+  With thousands of tasks running, showing them all in index order tells
+  nothing. Instead, draw only [row_count] of them, chosen every frame:
+
+  | cprogress_setdisplay(cprogress: cprogress_t *, policy: cprogress_displaypolicy_t, row_count: int);
+
+  | CPROGRESS_DISPLAY_INDEX            the first ones, the default
+  | CPROGRESS_DISPLAY_LOWESTPROGRESS   the least done
+  | CPROGRESS_DISPLAY_LOWESTRATE       the slowest
+  | CPROGRESS_DISPLAY_STALEST          the longest since their percentage changed
+
+  The renderer watches every running task for when its percentage last
+  changed and how fast it goes, a rate that fades while it stalls. The
+  chosen ones are kept in a heap of [row_count] entries, so a frame costs
+  a pass over the tasks rather than a sort, and they are drawn in index
+  order so the rows don't jump around. A [row_count] of zero draws all of
+  them again. When pinned, the pinned rows cap [row_count].
+
+
+  HISTORY
+  =======
+
+  Every so often, the renderer samples how far each running task went
+  since the previous sample, and keeps the last ones in a ring per task.
+  The updaters don't pay for it. A "$16s" in the format draws the last 16
+  as a sparkline, stalls show up as gaps:
+
+  | Downloading [########            ] ▂▃▅▇▇▆▃    ▂▅▇
+
+  A format with a sparkline turns it on, wide enough for it. Otherwise, or
+  to keep more of them or sample at another pace:
+
+  | cprogress_sethistory(cprogress: cprogress_t *, length: size_t, interval_ms: long);
+  | cprogress_gettaskhistory(cprogress: cprogress_t *, task_index: int, samples: float *, samples_length: size_t *);
+
+  A sample takes two bytes, a task takes [length] of them from its first
+  sample on, so 10000 tasks keeping 64 cost 1.25 MiB. A [length] of zero
+  turns it off and frees them all. Both are to be called from the render
+  thread, samples come out oldest first, in percent.
+
+
+  PINNING
+  =======
+
+  | cprogress_pin(cprogress: cprogress_t *, row_count: int);
+
+  Reserves the bottom [row_count] rows of the terminal for the bars with a
+  scroll region, anything else printed scrolls natively above them, so
+  heavy output doesn't cost a repaint of the bars. cprogress_render(...)
+  then draws at most [row_count] running tasks there, finished ones scroll
+  away with the output. Returns CPROGRESS_ERROR_UNSUPPORTED when stdout is
+  not a terminal.
+
+  cprogress_unpin(...), cprogress_destroy(...) or the end of the run give
+  the rows back. So do exit(3) and fatal signals left to their default
+  action, so a crash won't leave the terminal with a scroll region.
+
+
+  TERMINALS
+  =========
+
+  What the terminal understands is guessed once from TERM, COLORTERM and
+  friends, and stored in [cprogress.termcaps] when an instance is created,
+  a bitwise or of cprogress_termcap_t. To ask the terminal itself, before
+  creating instances:
+
+  | cprogress_console_querycaps(timeout_ms: long);
+
+  It asks for synchronized output (mode 2026) with DECRQM, followed by DA1
+  which every terminal answers, so it only waits [timeout_ms] when there is
+  no terminal to answer at all. With CPROGRESS_TERMCAP_SYNC every frame is
+  drawn by the terminal at once, without tearing.
+
+  Colors are left out when stdout is not a terminal, or NO_COLOR is set to
+  anything, see https://no-color.org.
+
+
+  SLOW TERMINALS
+  ==============
+
+  Over a slow link, writing a frame may take longer than the time between
+  two of them, and output backs up. How long each frame takes to write is
+  watched, and once it goes over the budget, step by step:
+
+  | 1. cprogress_waitfps(...) waits twice as long, up to
+  |    CPROGRESS_RENDER_MAXFPSDIVISOR times
+  | 2. CPROGRESS_DETAIL_COLLAPSED: running tasks are drawn as one line with
+  |    their count and average percentage
+  | 3. CPROGRESS_DETAIL_MINIMAL: sparklines and custom conversions are left
+  |    out too
+
+  and back the other way once frames are written well within it, waiting
+  longer each time it had to step down again right after. The current step
+  is in [cprogress.fps_divisor] and [cprogress.detail_level].
+
+  | cprogress_setframebudget(cprogress: cprogress_t *, budget_ms: long);
+
+  The budget defaults to CPROGRESS_RENDER_FRAMEBUDGET_MS, zero turns it
+  off and goes back to full detail.
+
 */
 
 #ifndef CPROGRESS_H
@@ -205,8 +604,14 @@
 
 
 
+#include "stdarg.h"
+#include "stddef.h"
 #include "stdint.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 
 #define CPROGRESS_UNDEF (-1)
 
@@ -219,7 +624,16 @@ typedef struct {
 } cprogress_stralloc_t;
 
 
-struct cprogress;
+/* the tag C code has always seen, C++ gets its own as cprogress names the
+  namespace of cprogress.hpp there */
+#ifdef __cplusplus
+# define CPROGRESS_STRUCT_TAG cprogress_instance
+#else
+# define CPROGRESS_STRUCT_TAG cprogress
+#endif
+
+struct CPROGRESS_STRUCT_TAG;
+struct cprogress_taskinfo;
 
 
 /* error */
@@ -228,6 +642,8 @@ typedef enum {
   CPROGRESS_ERROR_INVAL = 1,
   CPROGRESS_ERROR_BUFFUL,
   CPROGRESS_ERROR_INTERNAL,
+  CPROGRESS_ERROR_UNSUPPORTED, /* not available on this platform */
+  CPROGRESS_ERROR_SYSTEM, /* a system call failed, see errno */
 } cprogress_error_t;
 
 
@@ -238,8 +654,43 @@ typedef enum {
   CPROGRESS_DISPLAYCHUNK_TITLE,
   CPROGRESS_DISPLAYCHUNK_BAR,
   CPROGRESS_DISPLAYCHUNK_PERCENTAGE,
+  CPROGRESS_DISPLAYCHUNK_SPARKLINE,
+  CPROGRESS_DISPLAYCHUNK_CUSTOM,
 } cprogress_displaychunk_type_t;
 
+/* style, see STYLES */
+typedef enum {
+  CPROGRESS_STYLE_COLORMASK = 0x1f, /* zero for the default, then black to white, then bright ones */
+  CPROGRESS_STYLE_BOLD = 1 << 5,
+  CPROGRESS_STYLE_DIM = 1 << 6,
+  CPROGRESS_STYLE_ITALIC = 1 << 7,
+  CPROGRESS_STYLE_UNDERLINE = 1 << 8,
+  CPROGRESS_STYLE_BYSTATE = 1 << 9, /* colored by the task when drawn */
+
+  CPROGRESS_STYLE_ATTRMASK = CPROGRESS_STYLE_BOLD | CPROGRESS_STYLE_DIM | CPROGRESS_STYLE_ITALIC | CPROGRESS_STYLE_UNDERLINE,
+} cprogress_style_t;
+
+#define CPROGRESS_STYLE_SGRMAXLEN 24 /* "\x1b[22;23;24;1;2;3;4;97m" */
+#define CPROGRESS_STYLE_STALL_MS 3000
+
+/* custom conversions, see CONVERSIONS */
+typedef size_t (cprogress_conversion_func_t (char *buf, size_t buf_len, size_t alloc_width,
+  struct CPROGRESS_STRUCT_TAG *cprogress, struct cprogress_taskinfo *taskinfo, void *userdata));
+
+typedef enum {
+  CPROGRESS_CONVERSION_FIXEDWIDTH, /* always writes [width] */
+  CPROGRESS_CONVERSION_MAXWIDTH, /* writes up to [width] */
+} cprogress_conversion_widthtype_t;
+
+#define CPROGRESS_CONVERSION_MAXWIDTH_LIMIT 256
+
+typedef struct {
+  cprogress_conversion_func_t *func;
+  void *userdata;
+  cprogress_conversion_widthtype_t width_type;
+  size_t width;
+} cprogress_conversion_t;
+
 typedef struct {
   cprogress_displaychunk_type_t type;
   union {
@@ -250,6 +701,12 @@ typedef struct {
 
   int is_autospan;
   size_t span_width;
+  int style; /* cprogress_style_t */
+
+  /* custom */
+  cprogress_conversion_t conversion;
+  size_t conversion_offset; /* into [conversion_buf], only measured ones */
+  size_t conversion_length; /* written while measuring */
 
   /* cache */
   size_t display_width;
@@ -258,24 +715,92 @@ typedef struct {
 #define cprogress_displaychunk_foreach(cp, name) for (cprogress_displaychunk_t *name = (cp)->displaychunks; name->type; ++name)
 
 
-/* taskinfo */
+/* stats
+  only counted with CPROGRESS_CONFIG_STATS */
+typedef struct {
+  uint64_t update_count; /* percentage updates */
+  uint64_t title_update_count;
+} cprogress_taskstats_t;
+
 typedef struct {
+  /* summed over all tasks */
+  uint64_t update_count;
+  uint64_t title_update_count;
+
+  uint64_t frame_count; /* frames written to the console */
+  uint64_t skipped_frame_count; /* frames with nothing to write */
+  uint64_t emitted_bytes;
+  uint64_t write_count; /* write(2) calls */
+  uint64_t consolewidth_query_count;
+
+  uint64_t render_ns; /* time spent in cprogress_render(...) */
+  uint64_t writeline_count;
+  uint64_t writeline_ns; /* time spent in cprogress_writeline(...) */
+} cprogress_stats_t;
+
+
+/* taskinfo */
+
+/* lifecycle, only ever changed by compare and swap, so each transition has
+  exactly one winner, and only the winner emits the event
+
+  idle -> starting -> running -> finishing -> done
+          ^                                -> aborted
+          '-- from any of the states that aren't running
+
+  finishing means stopped, but its final line is not drawn yet */
+typedef enum {
+  CPROGRESS_TASK_IDLE,
+  CPROGRESS_TASK_STARTING, /* being reset by cprogress_starttask(...) */
+  CPROGRESS_TASK_RUNNING,
+  CPROGRESS_TASK_FINISHING,
+  CPROGRESS_TASK_DONE,
+  CPROGRESS_TASK_ABORTED,
+
+  CPROGRESS_TASK_STATEMASK = 0xff,
+  CPROGRESS_TASK_ABORTING = 0x100, /* with finishing: ends up aborted */
+} cprogress_taskstate_t;
+
+typedef struct cprogress_taskinfo {
   /* persistent */
-  int is_valid; /* indicate if it's a EOF */
   int task_index;
 
-  int is_running;
+  int state; /* cprogress_taskstate_t */
   char *title;
   float percentage;
 
   /* internal */
-  int is_just_started;
-  int is_just_stopped;
+  int title_lock; /* held while [title] is swapped or read */
+  uint32_t visible_key; /* the percentage as last shown, see _cprogress_visiblekey(...) */
+  uint32_t generation; /* bumped by cprogress_task_release(...) */
+  uint32_t next_free_slot; /* slot + 1 */
+
+  /* only touched by the renderer, see DISPLAY POLICIES */
+  float display_percentage; /* when last seen */
+  float display_rate; /* percent per second */
+  int64_t display_change_ns; /* zero until seen running */
+  uint32_t display_mark; /* chosen for the current frame */
+
+  /* only touched by the renderer, see HISTORY */
+  uint16_t *history; /* ring of hundredths of a percent */
+  uint32_t history_count; /* ever pushed */
+  float history_percentage; /* at the last sample */
+
+#ifdef CPROGRESS_CONFIG_STATS
+  cprogress_taskstats_t stats;
+#endif
 } cprogress_taskinfo_t;
 
 #define cprogress_gettaskinfo(cp, task_index) ((cp)->taskinfos[task_index])
 #define cprogress_taskinfo_getindex(taskinfo) ((taskinfo)->task_index)
-#define cprogress_taskinfo_foreach(cp, name) for (cprogress_taskinfo_t *name = (cp)->taskinfos; name->is_valid; ++name)
+/* fixed tasks first, then acquired slots, told apart by index as pages
+  may sit anywhere around the fixed ones */
+#define cprogress_taskinfo_foreach(cp, name) \
+  for (cprogress_taskinfo_t *name = (cp)->taskinfos_length? (cp)->taskinfos: cprogress_taskinfo_nextslot(cp, NULL); \
+    name; \
+    name = (size_t) cprogress_taskinfo_getindex(name) + 1 < (cp)->taskinfos_length? name + 1: cprogress_taskinfo_nextslot(cp, name))
+#define cprogress_taskinfo_getstate(taskinfo) (__atomic_load_n(&(taskinfo)->state, __ATOMIC_ACQUIRE) & CPROGRESS_TASK_STATEMASK)
+#define cprogress_taskinfo_isrunning(taskinfo) (cprogress_taskinfo_getstate(taskinfo) == CPROGRESS_TASK_RUNNING)
 
 
 /* subscribe */
@@ -289,15 +814,220 @@ typedef enum {
   CPROGRESS_EVENT_LENGTH, /* indicate the maximum number of this enum, only use internally */
 } cprogress_event_type_t;
 
-typedef void (cprogress_eventsubscriber_func_t (struct cprogress *cprogress, int task_index));
+typedef void (cprogress_eventsubscriber_func_t (struct CPROGRESS_STRUCT_TAG *cprogress, int task_index));
+
+#define CPROGRESS_EVENT_MAXSUBSCRIBERS 4
+#define CPROGRESS_EVENT_QUEUELENGTH 256 /* default for cprogress_deferevents(...) */
+
+/* when the deferred queue is full */
+typedef enum {
+  CPROGRESS_EVENTS_DROP, /* lost, and counted in [events_dropped_count] */
+  CPROGRESS_EVENTS_BLOCK, /* the emitter waits for the render thread */
+} cprogress_eventpolicy_t;
+
+typedef struct {
+  int type;
+  int task_index;
+} cprogress_eventrecord_t;
+
+
+/* task slots
+  acquired on demand, page k holds CPROGRESS_TASKPAGE_BASELENGTH << k slots,
+  pages are never moved nor freed until destroyed */
+#define CPROGRESS_TASKPAGE_BASELENGTH 64
+#define CPROGRESS_TASKPAGE_MAXCOUNT 24
+
+typedef struct {
+  struct CPROGRESS_STRUCT_TAG *cprogress;
+  int index;
+  uint32_t generation;
+} cprogress_taskhandle_t;
+
+
+/* display policy */
+typedef enum {
+  CPROGRESS_DISPLAY_INDEX,
+  CPROGRESS_DISPLAY_LOWESTPROGRESS,
+  CPROGRESS_DISPLAY_LOWESTRATE,
+  CPROGRESS_DISPLAY_STALEST,
+
+  CPROGRESS_DISPLAY_LENGTH, /* only use internally */
+} cprogress_displaypolicy_t;
+
+#define CPROGRESS_DISPLAY_RATESMOOTHING 0.3f /* weight of the latest sample */
+#define CPROGRESS_DISPLAY_RATEHALFLIFE_NS 1000000000LL /* while stalled */
+
+typedef struct {
+  float key;
+  cprogress_taskinfo_t *taskinfo;
+} cprogress_displayentry_t;
+
+
+/* render */
+#define CPROGRESS_RENDER_REPAINT_MS 1000 /* at least, when time alone changes what is shown */
+#define CPROGRESS_RENDER_FRAMEBUDGET_MS 20 /* to write a frame, see SLOW TERMINALS */
+#define CPROGRESS_RENDER_MAXFPSDIVISOR 8
+#define CPROGRESS_RENDER_ADAPTFRAMES 8 /* between two steps */
+#define CPROGRESS_RENDER_MAXADAPTBACKOFF 6
+
+typedef enum {
+  CPROGRESS_DETAIL_FULL,
+  CPROGRESS_DETAIL_COLLAPSED, /* running tasks as one line */
+  CPROGRESS_DETAIL_MINIMAL, /* and without sparklines nor custom conversions */
+} cprogress_detail_t;
+
+
+/* history */
+#define CPROGRESS_HISTORY_LENGTH 64 /* for an auto spanned sparkline */
+#define CPROGRESS_HISTORY_MAXLENGTH 4096
+#define CPROGRESS_HISTORY_INTERVAL_MS 250
+
+
+/* terminal capabilities */
+typedef enum {
+  CPROGRESS_TERMCAP_ANSI = 1 << 0, /* CSI sequences at all */
+  CPROGRESS_TERMCAP_COLOR = 1 << 1,
+  CPROGRESS_TERMCAP_COLOR256 = 1 << 2,
+  CPROGRESS_TERMCAP_TRUECOLOR = 1 << 3,
+  CPROGRESS_TERMCAP_SYNC = 1 << 4, /* synchronized output, mode 2026 */
+} cprogress_termcap_t;
+
+
+/* log */
+#define CPROGRESS_LOG_LINEMAXLEN 248
+#define CPROGRESS_LOG_QUEUELENGTH 256 /* default for cprogress_openlog(...) */
+
+typedef enum {
+  CPROGRESS_LOG_DROP,
+  CPROGRESS_LOG_BLOCK,
+} cprogress_logpolicy_t;
+
+typedef struct {
+  char line[CPROGRESS_LOG_LINEMAXLEN];
+} cprogress_logrecord_t;
+
+
+/* mpsc queue
+  bounded and lock-free, any thread pushes, a single thread pops */
+typedef struct {
+  char *cells; /* [sequence, element] pairs */
+  size_t cell_size;
+  size_t element_size;
+  size_t mask; /* length - 1, length is a power of two */
+
+  char head_padding[64];
+  size_t head; /* next to pop, only touched by the consumer */
+  char tail_padding[64];
+  size_t tail; /* next to push */
+  char end_padding[64];
+} cprogress_mpsc_t;
+
+
+/* shared region
+  the layout is shared between processes, bump CPROGRESS_SHARED_VERSION on
+  any change */
+#define CPROGRESS_SHARED_MAGIC 0x47525043 /* "CPRG" */
+#define CPROGRESS_SHARED_VERSION 1
+#define CPROGRESS_SHARED_FMTLEN 256
+#define CPROGRESS_SHARED_TITLELEN 120
+#define CPROGRESS_SHARED_GRACE 5 /* seconds a region may go without an owner while being created */
+
+typedef struct {
+  uint32_t sequence; /* odd while the owner is writing this entry */
+  int32_t is_running;
+  float percentage;
+  char title[CPROGRESS_SHARED_TITLELEN];
+} cprogress_sharedtask_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  int32_t is_running;
+  int32_t owner_pid;
+  uint32_t task_count;
+  char fmt[CPROGRESS_SHARED_FMTLEN];
+  cprogress_sharedtask_t tasks[];
+} cprogress_shared_t;
+
+
+/* ingest
+  progress fed by other processes through a unix domain socket */
+#define CPROGRESS_INGEST_MAXCLIENTS 32
+#define CPROGRESS_INGEST_LINEMAXLEN 160
+#define CPROGRESS_INGEST_RECVSIZE 65536
+
+typedef struct {
+  int fd;
+  size_t pending_length; /* a line split across two recv(2) */
+  char pending[CPROGRESS_INGEST_LINEMAXLEN];
+} cprogress_ingestclient_t;
+
+typedef struct {
+  int listen_fd;
+  char *path;
+  char *recv_buf;
+
+  size_t clients_length;
+  cprogress_ingestclient_t clients[CPROGRESS_INGEST_MAXCLIENTS];
+
+  uint64_t applied_count;
+  uint64_t rejected_count;
+} cprogress_ingest_t;
+
+
+/* tick
+  frames due, as a file descriptor to wait on */
+typedef struct {
+  int epoll_fd; /* readable when cprogress_tick(...) has something to do */
+  int timer_fd;
+  int event_fd;
+} cprogress_tick_t;
+
+
+/* parallel for */
+#define CPROGRESS_PARALLEL_MAXWORKERS 256
+#define CPROGRESS_PARALLEL_FPS 30
+#define CPROGRESS_PARALLEL_CHUNKSPERWORKER 16 /* when no grain is given */
+
+typedef enum {
+  CPROGRESS_PARALLEL_WORKERROWS = 1 << 0, /* a row per worker besides the whole loop */
+  CPROGRESS_PARALLEL_NORENDER = 1 << 1, /* rendered by another thread */
+} cprogress_parallelflag_t;
+
+typedef void (cprogress_parallel_func_t (long begin, long end, int worker_index, void *ctx));
+
+
+/* io
+  file descriptors read or copied as a task */
+#define CPROGRESS_IO_CHUNKSIZE (8 << 20) /* bytes moved between two updates, at least */
+#define CPROGRESS_IO_BUFSIZE (1 << 20) /* when the kernel can't copy by itself */
+#define CPROGRESS_IO_BUFALIGN 4096
+#define CPROGRESS_IO_READAHEAD (4 << 20) /* hinted ahead of a reader */
+
+typedef struct {
+  struct CPROGRESS_STRUCT_TAG *cprogress;
+  int task_index;
+  int fd;
+  int64_t base; /* the offset it was opened at */
+  int64_t length; /* -1 when not a regular file */
+  int64_t offset; /* read so far */
+  int64_t reported_offset;
+  int64_t hinted_offset; /* readahead asked for till there */
+} cprogress_reader_t;
 
 
 /* instance */
-typedef struct cprogress {
+typedef struct CPROGRESS_STRUCT_TAG {
   cprogress_error_t error;
 
   /* creating */
   int has_autospan_element;
+  char *conversion_buf; /* for custom conversions of unknown width */
+  int style_mask; /* what the terminal may show, zero when unstyled */
+  int has_statestyle;
+  int has_percentage_element;
+  int has_sparkline_element;
+  int has_custom_element; /* may change on its own, drawn every frame */
 
   size_t displaychunks_length;
   cprogress_displaychunk_t *displaychunks;
@@ -308,16 +1038,88 @@ typedef struct cprogress {
 
   int is_running;
   int is_rendering;
+  int has_rendered_tasks; /* in this frame */
+  int is_dirty; /* something visible changed since the last frame */
+  uint32_t visible_bar_width; /* lcm of the bar widths, to tell what is visible */
+  uint32_t frame_bar_width;
+  int64_t repaint_ns;
   int last_alive_task_count;
   size_t taskinfos_length;
   cprogress_taskinfo_t *taskinfos;
 
-  cprogress_eventsubscriber_func_t *subscribers[CPROGRESS_EVENT_LENGTH];
+  cprogress_taskinfo_t *taskpages[CPROGRESS_TASKPAGE_MAXCOUNT];
+  size_t taskslots_length; /* ever handed out, each with its page there */
+  uint64_t taskslots_freehead; /* tag << 32 | (slot + 1) */
+
+  cprogress_eventsubscriber_func_t *subscribers[CPROGRESS_EVENT_LENGTH][CPROGRESS_EVENT_MAXSUBSCRIBERS];
+  cprogress_mpsc_t *events; /* only when deferred */
+  cprogress_eventpolicy_t events_policy;
+  uint64_t events_dropped_count;
+  uint64_t events_thread; /* the one delivering them, see cprogress_thread_self() */
+
+  cprogress_mpsc_t *log; /* only when opened */
+  cprogress_logpolicy_t log_policy;
+  uint64_t log_dropped_count;
+  uint64_t log_thread; /* the one draining it, see cprogress_thread_self() */
+
+  /* sharing */
+  char *fmt;
+  cprogress_shared_t *shared;
+  size_t shared_size;
+  char *shared_name;
+  cprogress_ingest_t *ingest;
+
+  /* parallel for */
+  int parallel_worker_count; /* zero for one per core */
+  int parallel_flags; /* cprogress_parallelflag_t */
+
+  /* event loops */
+  cprogress_tick_t *tick; /* only when opened */
+  int64_t tick_ns; /* last frame drawn by cprogress_tick(...) */
 
   /* platform */
   int console_width;
-  int keep_consolewidth_loopcount;
+  int keep_consolewidth_loopcount; /* only where resizes can't be watched */
+  int consolewidth_generation;
+  int console_height; /* only queried when pinned */
+  int termcaps; /* cprogress_termcap_t */
+
+  /* display policy, zero rows for all of them */
+  cprogress_displaypolicy_t display_policy;
+  int display_row_count;
+  cprogress_displayentry_t *display_heap;
+  uint32_t display_mark;
+
+  /* history, zero length when off */
+  size_t history_length;
+  int64_t history_interval_ns;
+  int64_t history_sample_ns;
+
+  /* adapting to slow terminals, see SLOW TERMINALS */
+  int64_t frame_budget_ns; /* zero to never adapt */
+  int64_t frame_write_ns; /* moving average */
+  int64_t last_write_ns;
+  int adapt_frame_count; /* since the last step */
+  int adapt_backoff; /* log2 of how many more frames to wait before stepping up */
+  int adapt_last_step; /* +1 up, -1 down */
+  int fps_divisor; /* 1 at full rate */
+  cprogress_detail_t detail_level;
+
+  /* pinning, zero rows when not pinned */
+  int pinned_row_count;
+  int pinned_console_height; /* the scroll region is set for */
   char *line_buf;
+  cprogress_taskinfo_t *line_taskinfo; /* whose line is being composed, if any */
+
+  /* a frame is composed here and written at once */
+  char *frame_buf;
+  size_t frame_length;
+  size_t frame_size;
+  size_t frame_begin_length; /* what cprogress_beginrender(...) put there */
+
+#ifdef CPROGRESS_CONFIG_STATS
+  cprogress_stats_t stats;
+#endif
 } cprogress_t;
 
 
@@ -335,6 +1137,25 @@ void cprogress_aborttask(cprogress_t *cprogress, int task_index);
 
 void cprogress_startalltasks(cprogress_t *cprogress);
 
+/* task controller: dynamic tasks, see DYNAMIC TASKS */
+cprogress_taskhandle_t cprogress_task_acquire(cprogress_t *cprogress);
+void cprogress_task_release(cprogress_taskhandle_t task);
+int cprogress_task_isvalid(cprogress_taskhandle_t task);
+int cprogress_task_isrunning(cprogress_taskhandle_t task);
+void cprogress_task_start(cprogress_taskhandle_t task);
+void cprogress_task_abort(cprogress_taskhandle_t task);
+cprogress_taskinfo_t *cprogress_taskinfo_nextslot(cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo);
+cprogress_taskinfo_t *cprogress_findtaskinfo(cprogress_t *cprogress, int task_index); /* NULL if there's none */
+
+/* task controller: parallel loops, see PARALLEL LOOPS */
+int cprogress_parallel_for(cprogress_t *cprogress, long begin, long end, long grain,
+  cprogress_parallel_func_t *func, void *ctx);
+int cprogress_setparallel(cprogress_t *cprogress, int worker_count, int flags);
+
+/* custom conversions, see CONVERSIONS */
+int cprogress_registerconversion(char conversion, cprogress_conversion_func_t *func, void *userdata,
+  cprogress_conversion_widthtype_t width_type, size_t width);
+
 /* view basic */
 size_t cprogress_writeliteral(char *buf, size_t buf_len, const char *literal, size_t alloc_width);
 size_t cprogress_writepercentage(char *buf, size_t buf_len, float percentage, size_t alloc_width);
@@ -354,25 +1175,95 @@ void cprogress_endrender(cprogress_t *cprogress);
 void cprogress_printline(cprogress_t *cprogress, const char *title, float percentage);
 void cprogress_render(cprogress_t *cprogress);
 void cprogress_rendersum(cprogress_t *cprogress, const char *title);
+int cprogress_setdisplay(cprogress_t *cprogress, cprogress_displaypolicy_t policy, int row_count);
+int cprogress_setframebudget(cprogress_t *cprogress, long budget_ms);
 /* view controller alternative: one line to show all till none left */
 void cprogress_render_tillcomplete(cprogress_t *cprogress, int fps);
 
 void cprogress_waitms(cprogress_t *cprogress, long ms);
 void cprogress_waitfps(cprogress_t *cprogress, int fps);
 
+/* view controller alternative: driven by an event loop of yours */
+int64_t cprogress_tick(cprogress_t *cprogress, int fps);
+int64_t cprogress_nanotime(); /* monotonic, the clock of those deadlines */
+int cprogress_tick_open(cprogress_t *cprogress);
+void cprogress_tick_close(cprogress_t *cprogress);
+
 
 /* data provider */
+void cprogress_taskinfo_updatetitle(cprogress_taskinfo_t *taskinfo, const char *title);
+void cprogress_taskinfo_updatetitlen(cprogress_taskinfo_t *taskinfo, const char *title, size_t title_length);
 void cprogress_updatetask_title(cprogress_t *cprogress, int task_index, const char *title);
+void cprogress_updatetask_titlen(cprogress_t *cprogress, int task_index, const char *title, size_t title_length);
 void cprogress_updatetask_percentage(cprogress_t *cprogress, int task_index, float percentage);
+void cprogress_updatetask_addpercentage(cprogress_t *cprogress, int task_index, float delta);
+void cprogress_task_updatetitle(cprogress_taskhandle_t task, const char *title);
+void cprogress_task_updatetitlen(cprogress_taskhandle_t task, const char *title, size_t title_length);
+void cprogress_task_updatepercentage(cprogress_taskhandle_t task, float percentage);
+void cprogress_task_addpercentage(cprogress_taskhandle_t task, float delta);
+
+/* data provider: file descriptors, see FILES */
+int64_t cprogress_copy_fd(cprogress_t *cprogress, int task_index, int in_fd, int out_fd, int64_t length);
+int64_t cprogress_copy_fdcounted(cprogress_t *cprogress, int task_index, int in_fd, int out_fd, int64_t length,
+  int64_t *counted);
+int cprogress_reader_open(cprogress_reader_t *reader, cprogress_t *cprogress, int task_index, int fd);
+int64_t cprogress_reader_read(cprogress_reader_t *reader, void *buf, size_t length);
 
 /* event controller */
-void cprogress_subscribeevent(cprogress_t *cprogress, cprogress_event_type_t type, cprogress_eventsubscriber_func_t *func);
+int cprogress_subscribeevent(cprogress_t *cprogress, cprogress_event_type_t type, cprogress_eventsubscriber_func_t *func);
+void cprogress_unsubscribeevent(cprogress_t *cprogress, cprogress_event_type_t type, cprogress_eventsubscriber_func_t *func);
 void cprogress_emitevent(cprogress_t *cprogress, cprogress_event_type_t type, int task_index);
+int cprogress_deferevents(cprogress_t *cprogress, size_t queue_length, cprogress_eventpolicy_t policy);
+void cprogress_flushevents(cprogress_t *cprogress);
+
+/* shared region: owner side */
+int cprogress_share(cprogress_t *cprogress, const char *name);
+void cprogress_share_publish(cprogress_t *cprogress);
+void cprogress_share_tillcomplete(cprogress_t *cprogress, int fps);
+void cprogress_unshare(cprogress_t *cprogress);
+
+/* shared region: viewer side */
+const cprogress_shared_t *cprogress_share_attach(const char *name, size_t *size);
+void cprogress_share_detach(const cprogress_shared_t *shared, size_t size);
+int cprogress_share_read(const cprogress_shared_t *shared, cprogress_t *mirror);
+
+/* ingest */
+int cprogress_ingest_listen(cprogress_t *cprogress, const char *path);
+int cprogress_ingest_poll(cprogress_t *cprogress, long timeout_ms);
+size_t cprogress_ingest_apply(cprogress_t *cprogress, const char *buf, size_t len);
+void cprogress_ingest_close(cprogress_t *cprogress);
+
+/* stats, see CPROGRESS_CONFIG_STATS
+  both return CPROGRESS_ERROR_UNSUPPORTED and zeros when it's not defined */
+int cprogress_getstats(cprogress_t *cprogress, cprogress_stats_t *stats);
+int cprogress_gettaskstats(cprogress_t *cprogress, int task_index, cprogress_taskstats_t *stats);
+
+/* terminals, see TERMINALS */
+int cprogress_console_getcaps();
+int cprogress_console_querycaps(long timeout_ms);
+
+/* history, see HISTORY */
+int cprogress_sethistory(cprogress_t *cprogress, size_t length, long interval_ms);
+int cprogress_gettaskhistory(cprogress_t *cprogress, int task_index, float *samples, size_t *samples_length);
+
+/* pinning, see PINNING */
+int cprogress_pin(cprogress_t *cprogress, int row_count);
+void cprogress_unpin(cprogress_t *cprogress);
+
+/* log, see LOGGING */
+int cprogress_openlog(cprogress_t *cprogress, size_t queue_length, cprogress_logpolicy_t policy);
+int cprogress_log(cprogress_t *cprogress, const char *fmt, ...);
+int cprogress_vlog(cprogress_t *cprogress, const char *fmt, va_list va);
 
 /* util
-  if you want to show other things while rendering */
+  if you want to show other things while rendering
+  prefer cprogress_log(...), this one may tear the bars apart */
 void cprogress_logf(const char *fmt, ...);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* !CPROGRESS_H */
 
 
@@ -389,7 +1280,18 @@ void cprogress_logf(const char *fmt, ...);
 #include "string.h"
 #include "time.h"
 
+#ifndef CPROGRESS_MALLOC
+# define CPROGRESS_MALLOC(size) malloc(size)
+#endif
+#ifndef CPROGRESS_REALLOC
+# define CPROGRESS_REALLOC(ptr, size) realloc(ptr, size)
+#endif
+#ifndef CPROGRESS_FREE
+# define CPROGRESS_FREE(ptr) free(ptr)
+#endif
+
 #define CPROGRESS_CONSOLE_UPDATEWIDTH_LOOPCOUNT 10
+#define CPROGRESS_CONSOLE_DEFAULTWIDTH 80
 #define CPROGRESS_DISPLAYCHUNK_MAXLEN 16
 
 
@@ -401,17 +1303,52 @@ void cprogress_logf(const char *fmt, ...);
 #define cprogress_panic(msg) { fprintf(stderr, "\n[E] (cprogress:%d): %s\n", __LINE__, msg); exit(1); }
 #define cprogress_panicf(msg, ...) { fprintf(stderr, "\n[E] (cprogress:%d): " msg "\n", __LINE__, __VA_ARGS__); exit(1); }
 
+/* updaters may run on any thread, so anything they share with the renderer
+  goes through these */
+#define cprogress_atomic_load(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define cprogress_atomic_store(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+#define cprogress_relaxed_load(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#define cprogress_relaxed_store(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELAXED)
+#define cprogress_relaxed_add(ptr, value) __atomic_add_fetch(ptr, value, __ATOMIC_RELAXED)
+
+#ifdef CPROGRESS_CONFIG_STATS
+# define cprogress_stats_add(counter, value) cprogress_relaxed_add(&(counter), value)
+# define cprogress_stats_begintimer(name) int64_t name = cprogress_nanotime()
+# define cprogress_stats_endtimer(counter, name) cprogress_stats_add(counter, cprogress_nanotime() - name)
+#else
+# define cprogress_stats_add(counter, value) ((void) 0)
+# define cprogress_stats_begintimer(name) ((void) 0)
+# define cprogress_stats_endtimer(counter, name) ((void) 0)
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+# define cprogress_cpu_relax() __builtin_ia32_pause()
+#else
+# define cprogress_cpu_relax() ((void) 0)
+#endif
+
 char *cprogress_strdup(const char *str) {
   if (str) {
-    char * newstr = (char *) malloc(strlen(str));
+    char * newstr = (char *) CPROGRESS_MALLOC(strlen(str) + 1);
     strcpy(newstr, str);
     return newstr;
   }
   return NULL;
 }
 
+/* [len] chars of [str], which needs no terminating NUL */
+char *cprogress_strndup(const char *str, size_t len) {
+  if (str) {
+    char *newstr = (char *) CPROGRESS_MALLOC(len + 1);
+    memcpy(newstr, str, len);
+    newstr[len] = '\0';
+    return newstr;
+  }
+  return NULL;
+}
+
 cprogress_stralloc_t cprogress_stralloc_create(size_t size) {
-  char *buffer = (char *) malloc(size);
+  char *buffer = (char *) CPROGRESS_MALLOC(size);
   cprogress_stralloc_t stralloc = {
     .buffer = buffer,
     .length = 0,
@@ -435,7 +1372,7 @@ char *cprogress_stralloc_alloc(cprogress_stralloc_t *stralloc, const char *str,
 void cprogress_stralloc_destroy(cprogress_stralloc_t *stralloc) {
   if (stralloc) {
     if (stralloc->buffer) {
-      free(stralloc->buffer);
+      CPROGRESS_FREE(stralloc->buffer);
       stralloc->buffer = NULL;
     }
   }
@@ -447,7 +1384,15 @@ void cprogress_stralloc_destroy(cprogress_stralloc_t *stralloc) {
 ----------------------------------------------------------------------------*/
 
 void cprogress_msleep(long ms);
+void cprogress_yield();
+int64_t cprogress_nanotime(); /* monotonic */
 int cprogress_console_getwidth();
+int cprogress_console_getheight(); /* CPROGRESS_UNDEF if not a terminal */
+int cprogress_console_isterminal(); /* stdout */
+
+/* bumped every time the console is resized, so the width is only queried
+  again when it changes, CPROGRESS_UNDEF if resizes can't be watched */
+int cprogress_console_getwidthgeneration();
 
 /* cursor movement
 
@@ -464,40 +1409,234 @@ void cprogress_console_moverel(short x, short y);
 void cprogress_console_resetline();
 void cprogress_console_eraseline();
 
+/* write out [buf] as is, returns how many writes it took */
+int cprogress_console_write(const char *buf, size_t len);
 
-#ifdef CPROGRESS_CONFIG_NOPLATFORM
+/* cprogress_termcap_t from the environment, the platform part only adds
+  what it knows for sure */
+int _cprogress_console_platformcaps();
 
-/* TODO fallbacks */
+/* reset the scroll region if the process exits or gets killed meanwhile */
+void cprogress_console_guardmargins(int is_guarding);
 
-void cprogress_msleep(long ms) {}
-int cprogress_console_getwidth() { return 80; }
-void cprogress_console_moverel(short x, short y) {}
-void cprogress_console_resetline() {}
+/* threads, CPROGRESS_ERROR_UNSUPPORTED where there are none */
+typedef void (cprogress_thread_func_t (void *arg));
+typedef void *cprogress_thread_t;
+int cprogress_thread_create(cprogress_thread_t *thread, cprogress_thread_func_t *func, void *arg);
+void cprogress_thread_join(cprogress_thread_t thread);
+uint64_t cprogress_thread_self(); /* zero if threads can't be told apart */
+int cprogress_cpu_count(); /* online ones */
 
-#elif defined(_WIN32)
+#define CPROGRESS_CONSOLE_RESETMARGINS "\x1b" "7" "\x1b[r" "\x1b" "8" /* keeps the cursor */
 
-# include "windows.h"
 
-void cprogress_msleep(long ms) {
-  HANDLE timer;
-  if (!(timer = CreateWaitableTimer(NULL, TRUE, NULL)))
-    return;
-  LARGE_INTEGER li;
-  li.QuadPart = -(ms * 1000);
-  if (!SetWaitableTimer(timer, &li, 0, NULL, NULL, FALSE)) {
-    CloseHandle(timer);
-    return;
-  }
-  WaitForSingleObject(timer, INFINITE);
-  CloseHandle(timer);
-}
+/* terminal capabilities, from the environment once */
 
-int cprogress_console_getwidth() {
-  CONSOLE_SCREEN_BUFFER_INFO csbi;
-  GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi);
-  int columns = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+static int _cprogress_console_caps = CPROGRESS_UNDEF;
 
-  return columns;
+int _cprogress_console_hasenv(const char *name, const char *needle) {
+  const char *value = getenv(name);
+  return value && *value && (!needle || strstr(value, needle));
+}
+
+int _cprogress_console_detectcaps() {
+  int caps = _cprogress_console_platformcaps();
+
+  const char *term = getenv("TERM");
+  if (term && *term && strcmp(term, "dumb")) {
+    caps |= CPROGRESS_TERMCAP_ANSI | CPROGRESS_TERMCAP_COLOR;
+    if (strstr(term, "256color") || strstr(term, "direct"))
+      caps |= CPROGRESS_TERMCAP_COLOR256;
+  }
+
+  if (_cprogress_console_hasenv("COLORTERM", "truecolor") ||
+    _cprogress_console_hasenv("COLORTERM", "24bit"))
+    caps |= CPROGRESS_TERMCAP_COLOR256 | CPROGRESS_TERMCAP_TRUECOLOR;
+
+  if (!cprogress_console_isterminal() || _cprogress_console_hasenv("NO_COLOR", NULL))
+    caps &= ~(CPROGRESS_TERMCAP_COLOR | CPROGRESS_TERMCAP_COLOR256 | CPROGRESS_TERMCAP_TRUECOLOR);
+
+  /* known to do mode 2026, anything else has to be asked */
+  if ((term && (strstr(term, "kitty") || strstr(term, "foot") ||
+      strstr(term, "alacritty") || strstr(term, "wezterm") || strstr(term, "contour"))) ||
+    _cprogress_console_hasenv("TERM_PROGRAM", "WezTerm") ||
+    _cprogress_console_hasenv("TERM_PROGRAM", "iTerm.app") ||
+    _cprogress_console_hasenv("TERM_PROGRAM", "ghostty") ||
+    _cprogress_console_hasenv("WT_SESSION", NULL))
+    caps |= CPROGRESS_TERMCAP_SYNC;
+
+  return caps;
+}
+
+void _cprogress_console_setcaps(int caps) {
+  cprogress_relaxed_store(&_cprogress_console_caps, caps);
+}
+
+int cprogress_console_getcaps() {
+  int caps = cprogress_relaxed_load(&_cprogress_console_caps);
+  if (caps == CPROGRESS_UNDEF) {
+    /* racing here only means detecting the same thing twice */
+    caps = _cprogress_console_detectcaps();
+    _cprogress_console_setcaps(caps);
+  }
+  return caps;
+}
+
+
+#ifdef CPROGRESS_CONFIG_NOPLATFORM
+
+/* TODO fallbacks */
+
+void cprogress_msleep(long ms) {}
+void cprogress_yield() {}
+int64_t cprogress_nanotime() { return 0; }
+int cprogress_console_getwidth() { return CPROGRESS_CONSOLE_DEFAULTWIDTH; }
+int cprogress_console_getheight() { return CPROGRESS_UNDEF; }
+int cprogress_console_isterminal() { return 0; }
+int _cprogress_console_platformcaps() { return 0; }
+int cprogress_console_querycaps(long timeout_ms) { return cprogress_console_getcaps(); }
+int cprogress_console_getwidthgeneration() { return 0; /* never changes */ }
+void cprogress_console_guardmargins(int is_guarding) {}
+int cprogress_thread_create(cprogress_thread_t *thread, cprogress_thread_func_t *func, void *arg) {
+  return CPROGRESS_ERROR_UNSUPPORTED;
+}
+void cprogress_thread_join(cprogress_thread_t thread) {}
+uint64_t cprogress_thread_self() { return 0; }
+int cprogress_cpu_count() { return 1; }
+void cprogress_console_moverel(short x, short y) {}
+void cprogress_console_resetline() {}
+void cprogress_console_eraseline() {}
+
+int cprogress_console_write(const char *buf, size_t len) {
+  fwrite(buf, 1, len, stdout);
+  fflush(stdout);
+  return 1;
+}
+
+#elif defined(_WIN32)
+
+# include "windows.h"
+
+void cprogress_msleep(long ms) {
+  HANDLE timer;
+  if (!(timer = CreateWaitableTimer(NULL, TRUE, NULL)))
+    return;
+  LARGE_INTEGER li;
+  li.QuadPart = -(ms * 1000);
+  if (!SetWaitableTimer(timer, &li, 0, NULL, NULL, FALSE)) {
+    CloseHandle(timer);
+    return;
+  }
+  WaitForSingleObject(timer, INFINITE);
+  CloseHandle(timer);
+}
+
+void cprogress_yield() {
+  SwitchToThread();
+}
+
+int64_t cprogress_nanotime() {
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (int64_t) (counter.QuadPart / frequency.QuadPart * 1000000000LL +
+    counter.QuadPart % frequency.QuadPart * 1000000000LL / frequency.QuadPart);
+}
+
+int cprogress_console_getwidth() {
+  CONSOLE_SCREEN_BUFFER_INFO csbi;
+  GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi);
+  int columns = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+
+  return columns;
+}
+
+int cprogress_console_getheight() {
+  CONSOLE_SCREEN_BUFFER_INFO csbi;
+  if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi))
+    return CPROGRESS_UNDEF;
+  return csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+}
+
+int cprogress_console_getwidthgeneration() {
+  /* no resize signal here, keep polling */
+  return CPROGRESS_UNDEF;
+}
+
+int cprogress_console_isterminal() {
+  DWORD mode;
+  return GetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), &mode) != 0;
+}
+
+int _cprogress_console_platformcaps() {
+  /* cprogress_console_write(...) turns on VT processing */
+  int caps = CPROGRESS_TERMCAP_ANSI | CPROGRESS_TERMCAP_COLOR | CPROGRESS_TERMCAP_COLOR256;
+  if (getenv("WT_SESSION"))
+    caps |= CPROGRESS_TERMCAP_TRUECOLOR | CPROGRESS_TERMCAP_SYNC; /* Windows Terminal */
+  return caps;
+}
+
+int cprogress_console_querycaps(long timeout_ms) {
+  return cprogress_console_getcaps();
+}
+
+static int _cprogress_console_isguardingmargins = 0;
+
+void _cprogress_console_restoremargins() {
+  if (!_cprogress_console_isguardingmargins) return;
+  fputs(CPROGRESS_CONSOLE_RESETMARGINS, stdout);
+  fflush(stdout);
+}
+
+void cprogress_console_guardmargins(int is_guarding) {
+  static int is_registered = 0;
+  if (is_guarding && !is_registered) {
+    atexit(_cprogress_console_restoremargins);
+    is_registered = 1;
+  }
+  _cprogress_console_isguardingmargins = is_guarding;
+}
+
+typedef struct {
+  HANDLE handle;
+  cprogress_thread_func_t *func;
+  void *arg;
+} _cprogress_thread_t;
+
+DWORD WINAPI _cprogress_thread_main(LPVOID userdata) {
+  _cprogress_thread_t *thread = (_cprogress_thread_t *) userdata;
+  thread->func(thread->arg);
+  return 0;
+}
+
+int cprogress_thread_create(cprogress_thread_t *thread, cprogress_thread_func_t *func, void *arg) {
+  _cprogress_thread_t *created = (_cprogress_thread_t *) CPROGRESS_MALLOC(sizeof(_cprogress_thread_t));
+  if (!created) return CPROGRESS_ERROR_INTERNAL;
+  created->func = func;
+  created->arg = arg;
+  if (!(created->handle = CreateThread(NULL, 0, _cprogress_thread_main, created, 0, NULL))) {
+    CPROGRESS_FREE(created);
+    return CPROGRESS_ERROR_SYSTEM;
+  }
+  *thread = created;
+  return CPROGRESS_ERROR_OK;
+}
+
+void cprogress_thread_join(cprogress_thread_t thread) {
+  _cprogress_thread_t *joined = (_cprogress_thread_t *) thread;
+  WaitForSingleObject(joined->handle, INFINITE);
+  CloseHandle(joined->handle);
+  CPROGRESS_FREE(joined);
+}
+
+uint64_t cprogress_thread_self() {
+  return GetCurrentThreadId();
+}
+
+int cprogress_cpu_count() {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0? (int) info.dwNumberOfProcessors: 1;
 }
 
 COORD _cprogress_console_getcursorpos() {
@@ -530,9 +1669,32 @@ void cprogress_console_eraseline() {
   printf("\x1b[2K"); fflush(stdout);
 }
 
+int cprogress_console_write(const char *buf, size_t len) {
+  /* frames are composed with ANSI sequences */
+  static int is_vt_enabled = 0;
+  if (!is_vt_enabled) {
+    HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode;
+    if (GetConsoleMode(console, &mode))
+      SetConsoleMode(console, mode | 0x0004 /* ENABLE_VIRTUAL_TERMINAL_PROCESSING */);
+    is_vt_enabled = 1;
+  }
+
+  fwrite(buf, 1, len, stdout);
+  fflush(stdout);
+  return 1;
+}
+
 #else
 
+# include "errno.h"
+# include "fcntl.h"
+# include "poll.h"
+# include "pthread.h"
+# include "sched.h"
+# include "signal.h"
 # include "sys/ioctl.h"
+# include "termios.h"
 # include "unistd.h"
 
 void cprogress_msleep(long ms) {
@@ -543,12 +1705,146 @@ void cprogress_msleep(long ms) {
   nanosleep(&ts, NULL);
 }
 
+void cprogress_yield() {
+  sched_yield();
+}
+
+int64_t cprogress_nanotime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 int cprogress_console_getwidth() {
   struct winsize w = {};
-  ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
+  /* not a terminal, e.g. redirected to a file */
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) || !w.ws_col)
+    return CPROGRESS_CONSOLE_DEFAULTWIDTH;
   return w.ws_col;
 }
 
+int cprogress_console_isterminal() {
+  return isatty(STDOUT_FILENO);
+}
+
+int _cprogress_console_platformcaps() { return 0; }
+
+int cprogress_console_querycaps(long timeout_ms) {
+  int caps = cprogress_console_getcaps();
+
+  int fd = open("/dev/tty", O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (fd < 0) return caps;
+
+  /* the answer must not be echoed nor wait for a newline */
+  struct termios saved_termios, raw_termios;
+  if (tcgetattr(fd, &saved_termios)) {
+    close(fd);
+    return caps;
+  }
+  raw_termios = saved_termios;
+  raw_termios.c_lflag &= ~(ICANON | ECHO);
+  raw_termios.c_cc[VMIN] = 0;
+  raw_termios.c_cc[VTIME] = 0;
+  tcsetattr(fd, TCSANOW, &raw_termios);
+
+  /* DECRQM for mode 2026, then DA1 to know when to stop waiting */
+  static const char query[] = "\x1b[?2026$p" "\x1b[c";
+  char reply[256];
+  size_t reply_length = 0;
+  int is_answered = 0;
+
+  if (write(fd, query, sizeof(query) - 1) == sizeof(query) - 1) {
+    int64_t deadline = cprogress_nanotime() + timeout_ms * 1000000LL;
+    while (!is_answered && reply_length < sizeof(reply) - 1) {
+      int remaining_ms = (int) ((deadline - cprogress_nanotime()) / 1000000LL);
+      if (remaining_ms <= 0) break;
+
+      struct pollfd pfd = { .fd = fd, .events = POLLIN };
+      if (poll(&pfd, 1, remaining_ms) <= 0) break;
+      ssize_t read_length = read(fd, reply + reply_length, sizeof(reply) - 1 - reply_length);
+      if (read_length <= 0) break;
+      reply_length += read_length;
+      reply[reply_length] = '\0';
+
+      /* DA1 is "CSI ? ... c" */
+      const char *da = strstr(reply, "\x1b[?");
+      while (da) {
+        const char *end = da + 3;
+        while ((*end >= '0' && *end <= '9') || *end == ';') ++end;
+        if (*end == 'c') { is_answered = 1; break; }
+        da = strstr(da + 1, "\x1b[?");
+      }
+    }
+  }
+
+  tcsetattr(fd, TCSANOW, &saved_termios);
+  close(fd);
+
+  if (is_answered) {
+    caps |= CPROGRESS_TERMCAP_ANSI;
+
+    /* "CSI ? 2026 ; Ps $ y", 1 set and 2 reset are both fine, 0 unknown
+      and 4 permanently reset are not; no answer at all is not either */
+    const char *mode = reply_length? strstr(reply, "\x1b[?2026;"): NULL;
+    if (mode && (mode[8] == '1' || mode[8] == '2') && mode[9] == '$')
+      caps |= CPROGRESS_TERMCAP_SYNC;
+    else
+      caps &= ~CPROGRESS_TERMCAP_SYNC;
+
+    _cprogress_console_setcaps(caps);
+  }
+
+  return caps;
+}
+
+int cprogress_console_getheight() {
+  struct winsize w = {};
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) || !w.ws_row)
+    return CPROGRESS_UNDEF;
+  return w.ws_row;
+}
+
+static int _cprogress_console_widthgeneration = 0;
+static int _cprogress_console_iswatchingwidth = 0;
+static struct sigaction _cprogress_console_prevwinch;
+
+void _cprogress_console_onwinch(int sig, siginfo_t *info, void *context) {
+  cprogress_relaxed_add(&_cprogress_console_widthgeneration, 1);
+
+  /* whoever was there before us still wants to know */
+  if (_cprogress_console_prevwinch.sa_flags & SA_SIGINFO) {
+    if (_cprogress_console_prevwinch.sa_sigaction)
+      _cprogress_console_prevwinch.sa_sigaction(sig, info, context);
+  } else if (_cprogress_console_prevwinch.sa_handler != SIG_DFL &&
+    _cprogress_console_prevwinch.sa_handler != SIG_IGN) {
+    _cprogress_console_prevwinch.sa_handler(sig);
+  }
+}
+
+int cprogress_console_getwidthgeneration() {
+  if (!cprogress_atomic_load(&_cprogress_console_iswatchingwidth)) {
+    int expected = 0;
+    if (__atomic_compare_exchange_n(&_cprogress_console_iswatchingwidth, &expected, 1,
+      0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      struct sigaction sa = {};
+      sa.sa_sigaction = _cprogress_console_onwinch;
+      sa.sa_flags = SA_SIGINFO | SA_RESTART;
+      sigemptyset(&sa.sa_mask);
+      if (sigaction(SIGWINCH, &sa, &_cprogress_console_prevwinch)) {
+        cprogress_atomic_store(&_cprogress_console_iswatchingwidth, -1);
+        return CPROGRESS_UNDEF;
+      }
+      cprogress_atomic_store(&_cprogress_console_iswatchingwidth, 2);
+    }
+  }
+
+  /* being installed by someone else, or failed to */
+  if (cprogress_atomic_load(&_cprogress_console_iswatchingwidth) != 2)
+    return CPROGRESS_UNDEF;
+
+  return cprogress_relaxed_load(&_cprogress_console_widthgeneration) & 0x7fffffff;
+}
+
 void cprogress_console_moverel(short x, short y) {
   if (x > 0)
     printf("\x1b[%dC", x);
@@ -583,11 +1879,224 @@ void cprogress_console_eraseline() {
   printf("\x1b[2K"); fflush(stdout);
 }
 
+int cprogress_console_write(const char *buf, size_t len) {
+  /* keep the order with whatever is still buffered in stdout */
+  fflush(stdout);
+
+  int write_count = 0;
+  while (len) {
+    ssize_t written = write(STDOUT_FILENO, buf, len);
+    ++write_count;
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    buf += written;
+    len -= written;
+  }
+  return write_count;
+}
+
+static int _cprogress_console_isguardingmargins = 0;
+static const int _cprogress_console_fatalsignals[] = { SIGHUP, SIGINT, SIGQUIT, SIGTERM };
+#define _CPROGRESS_CONSOLE_FATALSIGNALS_LENGTH (sizeof(_cprogress_console_fatalsignals) / sizeof(int))
+static struct sigaction _cprogress_console_prevfatal[_CPROGRESS_CONSOLE_FATALSIGNALS_LENGTH];
+
+void _cprogress_console_restoremargins() {
+  if (!__atomic_exchange_n(&_cprogress_console_isguardingmargins, 0, __ATOMIC_ACQ_REL)) return;
+  /* async-signal-safe, no stdio */
+  ssize_t written = write(STDOUT_FILENO, CPROGRESS_CONSOLE_RESETMARGINS, sizeof(CPROGRESS_CONSOLE_RESETMARGINS) - 1);
+  (void) written;
+}
+
+void _cprogress_console_onfatalsignal(int sig, siginfo_t *info, void *context) {
+  for (size_t i = 0; i < _CPROGRESS_CONSOLE_FATALSIGNALS_LENGTH; ++i) {
+    if (_cprogress_console_fatalsignals[i] != sig) continue;
+    struct sigaction *prev = &_cprogress_console_prevfatal[i];
+
+    /* handled by the program, it may go on, so leave the region be */
+    if (prev->sa_flags & SA_SIGINFO) {
+      if (prev->sa_sigaction) prev->sa_sigaction(sig, info, context);
+      return;
+    }
+    if (prev->sa_handler == SIG_IGN) return;
+    if (prev->sa_handler != SIG_DFL) {
+      prev->sa_handler(sig);
+      return;
+    }
+
+    /* about to die, put the terminal back and die the same way */
+    _cprogress_console_restoremargins();
+    sigaction(sig, prev, NULL);
+    raise(sig);
+    return;
+  }
+}
+
+void cprogress_console_guardmargins(int is_guarding) {
+  static int is_registered = 0;
+  if (is_guarding && !is_registered) {
+    atexit(_cprogress_console_restoremargins);
+
+    struct sigaction sa = {};
+    sa.sa_sigaction = _cprogress_console_onfatalsignal;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    for (size_t i = 0; i < _CPROGRESS_CONSOLE_FATALSIGNALS_LENGTH; ++i)
+      sigaction(_cprogress_console_fatalsignals[i], &sa, &_cprogress_console_prevfatal[i]);
+    is_registered = 1;
+  }
+  cprogress_atomic_store(&_cprogress_console_isguardingmargins, is_guarding);
+}
+
+typedef struct {
+  pthread_t handle;
+  cprogress_thread_func_t *func;
+  void *arg;
+} _cprogress_thread_t;
+
+void *_cprogress_thread_main(void *userdata) {
+  _cprogress_thread_t *thread = (_cprogress_thread_t *) userdata;
+  thread->func(thread->arg);
+  return NULL;
+}
+
+int cprogress_thread_create(cprogress_thread_t *thread, cprogress_thread_func_t *func, void *arg) {
+  _cprogress_thread_t *created = (_cprogress_thread_t *) CPROGRESS_MALLOC(sizeof(_cprogress_thread_t));
+  if (!created) return CPROGRESS_ERROR_INTERNAL;
+  created->func = func;
+  created->arg = arg;
+  if (pthread_create(&created->handle, NULL, _cprogress_thread_main, created)) {
+    CPROGRESS_FREE(created);
+    return CPROGRESS_ERROR_SYSTEM;
+  }
+  *thread = created;
+  return CPROGRESS_ERROR_OK;
+}
+
+void cprogress_thread_join(cprogress_thread_t thread) {
+  _cprogress_thread_t *joined = (_cprogress_thread_t *) thread;
+  pthread_join(joined->handle, NULL);
+  CPROGRESS_FREE(joined);
+}
+
+uint64_t cprogress_thread_self() {
+  return (uint64_t) (uintptr_t) pthread_self();
+}
+
+int cprogress_cpu_count() {
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0? (int) count: 1;
+}
+
 
 #endif /* CPROGRESS_CONFIG_NOPLATFORM */
 
 
 
+/*----------------------------------------------------------------------------
+| sync
+----------------------------------------------------------------------------*/
+
+/* only guards pointer swaps and short copies, so spinning is cheaper than
+  a mutex, yield in case the holder got preempted */
+void cprogress_spin_lock(int *lock) {
+  for (int spins = 0; __atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE); ) {
+    while (cprogress_relaxed_load(lock)) {
+      if (++spins < 64) cprogress_cpu_relax();
+      else cprogress_yield();
+    }
+  }
+}
+
+void cprogress_spin_unlock(int *lock) {
+  __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+/* mpsc queue
+  every cell carries a sequence telling whose turn it is: equal to the
+  position when free to push, position + 1 when ready to pop */
+
+#define _cprogress_mpsc_cell(queue, pos) ((queue)->cells + ((pos) & (queue)->mask) * (queue)->cell_size)
+#define _cprogress_mpsc_sequence(cell) ((size_t *) (cell))
+#define _cprogress_mpsc_element(cell) ((cell) + sizeof(size_t))
+
+int cprogress_mpsc_create(cprogress_mpsc_t *queue, size_t length, size_t element_size) {
+  if (!queue || !length || !element_size) return CPROGRESS_ERROR_INVAL;
+
+  size_t rounded_length = 1;
+  while (rounded_length < length) rounded_length <<= 1;
+
+  memset(queue, 0, sizeof(cprogress_mpsc_t));
+  queue->element_size = element_size;
+  queue->cell_size = (sizeof(size_t) + element_size + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t);
+  queue->mask = rounded_length - 1;
+  queue->cells = (char *) CPROGRESS_MALLOC(rounded_length * queue->cell_size);
+  if (!queue->cells) return CPROGRESS_ERROR_INTERNAL;
+
+  for (size_t i = 0; i < rounded_length; ++i)
+    *_cprogress_mpsc_sequence(_cprogress_mpsc_cell(queue, i)) = i;
+
+  return CPROGRESS_ERROR_OK;
+}
+
+void cprogress_mpsc_destroy(cprogress_mpsc_t *queue) {
+  if (queue->cells) CPROGRESS_FREE(queue->cells);
+  queue->cells = NULL;
+}
+
+/* returns zero if full */
+int cprogress_mpsc_trypush(cprogress_mpsc_t *queue, const void *element) {
+  size_t pos = cprogress_relaxed_load(&queue->tail);
+  char *cell;
+  while (1) {
+    cell = _cprogress_mpsc_cell(queue, pos);
+    size_t sequence = cprogress_atomic_load(_cprogress_mpsc_sequence(cell));
+    intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+      /* [pos] is reloaded by the failed exchange */
+    } else if (diff < 0) {
+      return 0; /* the consumer hasn't got there yet */
+    } else {
+      pos = cprogress_relaxed_load(&queue->tail);
+    }
+  }
+
+  memcpy(_cprogress_mpsc_element(cell), element, queue->element_size);
+  cprogress_atomic_store(_cprogress_mpsc_sequence(cell), pos + 1);
+  return 1;
+}
+
+/* consumer only, returns zero if empty */
+int cprogress_mpsc_trypop(cprogress_mpsc_t *queue, void *element) {
+  size_t pos = queue->head;
+  char *cell = _cprogress_mpsc_cell(queue, pos);
+  if (cprogress_atomic_load(_cprogress_mpsc_sequence(cell)) != pos + 1)
+    return 0; /* empty, or the producer is still copying */
+
+  memcpy(element, _cprogress_mpsc_element(cell), queue->element_size);
+  cprogress_atomic_store(_cprogress_mpsc_sequence(cell), pos + queue->mask + 1);
+  queue->head = pos + 1;
+  return 1;
+}
+
+float cprogress_taskinfo_getpercentage(cprogress_taskinfo_t *taskinfo) {
+  float percentage;
+  __atomic_load(&taskinfo->percentage, &percentage, __ATOMIC_RELAXED);
+  return percentage;
+}
+
+void cprogress_taskinfo_setpercentage(cprogress_taskinfo_t *taskinfo, float percentage) {
+  __atomic_store(&taskinfo->percentage, &percentage, __ATOMIC_RELAXED);
+}
+
+#define cprogress_taskinfo_locktitle(taskinfo) cprogress_spin_lock(&(taskinfo)->title_lock)
+#define cprogress_taskinfo_unlocktitle(taskinfo) cprogress_spin_unlock(&(taskinfo)->title_lock)
+
+
 /*----------------------------------------------------------------------------
 | instance
 ----------------------------------------------------------------------------*/
@@ -675,6 +2184,82 @@ cprogress_token_t cprogress_peektoken(const char *str) {
 }
 
 
+/* style */
+
+static const char *_cprogress_style_colornames[] = {
+  "black", "red", "green", "yellow", "blue", "magenta", "cyan", "white",
+};
+
+/* the names between [ptr] and [end] */
+int _cprogress_parsestyle(const char *ptr, const char *end, int *style) {
+  *style = 0;
+  while (ptr < end) {
+    const char *name = ptr;
+    while (ptr < end && *ptr != ',') ++ptr;
+    size_t name_length = ptr - name;
+    if (ptr < end) ++ptr; /* the comma */
+
+    #define _cprogress_parsestyle_is(literal) \
+      (name_length == sizeof(literal) - 1 && !memcmp(name, literal, name_length))
+    int is_bright = name_length > 6 && !memcmp(name, "bright", 6);
+    if (is_bright) {
+      name += 6;
+      name_length -= 6;
+    }
+
+    int color = 0;
+    for (int i = 0; i < 8; ++i) {
+      if (strlen(_cprogress_style_colornames[i]) == name_length &&
+        !memcmp(name, _cprogress_style_colornames[i], name_length))
+        color = i + 1 + (is_bright? 8: 0);
+    }
+
+    if (color) *style = (*style & ~CPROGRESS_STYLE_COLORMASK) | color;
+    else if (is_bright) return 1;
+    else if (!name_length) continue;
+    else if (_cprogress_parsestyle_is("bold")) *style |= CPROGRESS_STYLE_BOLD;
+    else if (_cprogress_parsestyle_is("dim")) *style |= CPROGRESS_STYLE_DIM;
+    else if (_cprogress_parsestyle_is("italic")) *style |= CPROGRESS_STYLE_ITALIC;
+    else if (_cprogress_parsestyle_is("underline")) *style |= CPROGRESS_STYLE_UNDERLINE;
+    else if (_cprogress_parsestyle_is("state")) *style |= CPROGRESS_STYLE_BYSTATE;
+    else return 1;
+    #undef _cprogress_parsestyle_is
+  }
+  return 0;
+}
+
+
+#define _cprogress_printline_widthtolength(width) (width * 4 + 1)
+/* and room for styles */
+#define _cprogress_printline_buflength(width) \
+  (_cprogress_printline_widthtolength(width) + CPROGRESS_DISPLAYCHUNK_MAXLEN * CPROGRESS_STYLE_SGRMAXLEN)
+
+/* custom conversions, by letter */
+static cprogress_conversion_t _cprogress_conversions[52];
+
+cprogress_conversion_t *_cprogress_getconversion(char conversion) {
+  if (conversion >= 'a' && conversion <= 'z') return &_cprogress_conversions[conversion - 'a'];
+  if (conversion >= 'A' && conversion <= 'Z') return &_cprogress_conversions[conversion - 'A' + 26];
+  return NULL;
+}
+
+int cprogress_registerconversion(char conversion, cprogress_conversion_func_t *func, void *userdata,
+  cprogress_conversion_widthtype_t width_type, size_t width) {
+  cprogress_conversion_t *slot = _cprogress_getconversion(conversion);
+  if (!slot || strchr("tbps", conversion)) return CPROGRESS_ERROR_INVAL;
+  if (func && (width_type < CPROGRESS_CONVERSION_FIXEDWIDTH || width_type > CPROGRESS_CONVERSION_MAXWIDTH ||
+    !width || width > CPROGRESS_CONVERSION_MAXWIDTH_LIMIT))
+    return CPROGRESS_ERROR_INVAL;
+
+  *slot = (cprogress_conversion_t) {
+    .func = func,
+    .userdata = userdata,
+    .width_type = width_type,
+    .width = width,
+  };
+  return CPROGRESS_ERROR_OK;
+}
+
 int cprogress_pushchunk(cprogress_t *cprogress, cprogress_displaychunk_t displaychunk) {
   if (cprogress->displaychunks_length >= CPROGRESS_DISPLAYCHUNK_MAXLEN - 1) return 1;
   cprogress->displaychunks[cprogress->displaychunks_length++] = displaychunk;
@@ -685,28 +2270,42 @@ int cprogress_pushchunk(cprogress_t *cprogress, cprogress_displaychunk_t display
 #define _cprogress_create_returnerror(e) { cprogress_destroy(&cprogress); return (cprogress_t) { .error = e }; }
 cprogress_t cprogress_create(const char *fmt, int task_count) {
   cprogress_t cprogress = {
-    .displaychunks = (cprogress_displaychunk_t *) malloc(CPROGRESS_DISPLAYCHUNK_MAXLEN * sizeof(cprogress_displaychunk_t)),
+    .displaychunks = (cprogress_displaychunk_t *) CPROGRESS_MALLOC(CPROGRESS_DISPLAYCHUNK_MAXLEN * sizeof(cprogress_displaychunk_t)),
     .stralloc = cprogress_stralloc_create(strlen(fmt)),
     .is_running = 1,
     .taskinfos_length = task_count,
-    .taskinfos = (cprogress_taskinfo_t *) malloc((task_count + 1) * sizeof(cprogress_taskinfo_t)),
+    .taskinfos = (cprogress_taskinfo_t *) CPROGRESS_MALLOC((task_count? task_count: 1) * sizeof(cprogress_taskinfo_t)),
+
+    .fmt = cprogress_strdup(fmt),
 
-    .console_width = CPROGRESS_UNDEF
+    .is_dirty = 1,
+    .frame_budget_ns = CPROGRESS_RENDER_FRAMEBUDGET_MS * 1000000LL,
+    .fps_divisor = 1,
+    .console_width = CPROGRESS_UNDEF,
+    .consolewidth_generation = CPROGRESS_UNDEF,
+    .termcaps = cprogress_console_getcaps()
   };
 
-  if (!cprogress.displaychunks || !cprogress.stralloc.buffer || !cprogress.taskinfos)
+  /* a file gets none, NO_COLOR only takes colors */
+  if ((cprogress.termcaps & CPROGRESS_TERMCAP_ANSI) && cprogress_console_isterminal())
+    cprogress.style_mask |= CPROGRESS_STYLE_ATTRMASK;
+  if (cprogress.termcaps & CPROGRESS_TERMCAP_COLOR)
+    cprogress.style_mask |= CPROGRESS_STYLE_COLORMASK;
+
+  if (!cprogress.displaychunks || !cprogress.stralloc.buffer || !cprogress.taskinfos || !cprogress.fmt)
     _cprogress_create_returnerror(CPROGRESS_ERROR_INTERNAL);
 
   for (int i = 0; i < cprogress.taskinfos_length; ++i) {
     cprogress.taskinfos[i] = (cprogress_taskinfo_t) {
-      .is_valid = 1,
       .task_index = i,
+      .state = CPROGRESS_TASK_IDLE,
     };
   }
-  cprogress.taskinfos[cprogress.taskinfos_length] = (cprogress_taskinfo_t) { .is_valid = 0 };
 
   const char *literal = NULL;
   size_t literal_length = 0;
+  size_t conversion_buf_length = 0;
+  int style = 0;
 
   char last_ch = 0;
   for (const char *chptr = fmt; *chptr; ++chptr) {
@@ -718,7 +2317,8 @@ cprogress_t cprogress_create(const char *fmt, int task_count) {
           .type = CPROGRESS_DISPLAYCHUNK_LITERAL,
           .literal = literal,
           .literal_length = literal_length,
-          .span_width = CPROGRESS_UNDEF
+          .span_width = CPROGRESS_UNDEF,
+          .style = style
         };
         if (cprogress_pushchunk(&cprogress, displaychunk))
           _cprogress_create_returnerror(CPROGRESS_ERROR_BUFFUL);
@@ -728,8 +2328,20 @@ cprogress_t cprogress_create(const char *fmt, int task_count) {
         literal_length = 0;
       }
 
+      /* style, ${...}, nothing to push */
+      if (chptr[1] == '{') {
+        const char *style_end = strchr(chptr + 2, '}');
+        if (!style_end || _cprogress_parsestyle(chptr + 2, style_end, &style))
+          _cprogress_create_returnerror(CPROGRESS_ERROR_INVAL);
+        if (style & CPROGRESS_STYLE_BYSTATE) cprogress.has_statestyle = 1;
+        chptr = style_end;
+        last_ch = *chptr;
+        continue;
+      }
+
       cprogress_displaychunk_t displaychunk = {
-        .span_width = CPROGRESS_UNDEF
+        .span_width = CPROGRESS_UNDEF,
+        .style = style
       };
 
       /* parse current token */
@@ -772,7 +2384,18 @@ cprogress_t cprogress_create(const char *fmt, int task_count) {
       char peeked_next_char = *(chptr + 1);
       switch (fmt_name) {
         default:
-          _cprogress_create_returnerror(CPROGRESS_ERROR_INVAL);
+          if (!_cprogress_getconversion(fmt_name) || !_cprogress_getconversion(fmt_name)->func)
+            _cprogress_create_returnerror(CPROGRESS_ERROR_INVAL);
+          displaychunk.type = CPROGRESS_DISPLAYCHUNK_CUSTOM;
+          cprogress.has_custom_element = 1;
+          displaychunk.conversion = *_cprogress_getconversion(fmt_name);
+          /* measured by drawing, so it needs a place to be drawn */
+          if (displaychunk.conversion.width_type == CPROGRESS_CONVERSION_MAXWIDTH &&
+            displaychunk.span_width == CPROGRESS_UNDEF && !displaychunk.is_autospan) {
+            displaychunk.conversion_offset = conversion_buf_length;
+            conversion_buf_length += _cprogress_printline_widthtolength(displaychunk.conversion.width);
+          }
+          break;
         /* title, $[number]t */
         case 't':
           displaychunk.type = CPROGRESS_DISPLAYCHUNK_TITLE;
@@ -790,7 +2413,21 @@ cprogress_t cprogress_create(const char *fmt, int task_count) {
         /* progress percent, $[number]p */
         case 'p':
           displaychunk.type = CPROGRESS_DISPLAYCHUNK_PERCENTAGE;
+          cprogress.has_percentage_element = 1;
           break;
+        /* sparkline, $[number]s */
+        case 's': {
+          displaychunk.type = CPROGRESS_DISPLAYCHUNK_SPARKLINE;
+          cprogress.has_sparkline_element = 1;
+          if (displaychunk.span_width == CPROGRESS_UNDEF && !displaychunk.is_autospan)
+            _cprogress_create_returnerror(CPROGRESS_ERROR_INVAL);
+          /* keep enough to fill it */
+          size_t history_length = displaychunk.is_autospan? CPROGRESS_HISTORY_LENGTH: displaychunk.span_width;
+          if (history_length > CPROGRESS_HISTORY_MAXLENGTH) history_length = CPROGRESS_HISTORY_MAXLENGTH;
+          if (history_length > cprogress.history_length) cprogress.history_length = history_length;
+          cprogress.history_interval_ns = CPROGRESS_HISTORY_INTERVAL_MS * 1000000LL;
+          break;
+        }
       }
 
       /* we are ready to push the chunk */
@@ -812,7 +2449,8 @@ cprogress_t cprogress_create(const char *fmt, int task_count) {
       .type = CPROGRESS_DISPLAYCHUNK_LITERAL,
       .literal = literal,
       .literal_length = literal_length,
-      .span_width = CPROGRESS_UNDEF
+      .span_width = CPROGRESS_UNDEF,
+      .style = style
     };
     if (cprogress_pushchunk(&cprogress, displaychunk)) _cprogress_create_returnerror(CPROGRESS_ERROR_BUFFUL);
   }
@@ -820,20 +2458,60 @@ cprogress_t cprogress_create(const char *fmt, int task_count) {
   if (cprogress_pushchunk(&cprogress, (cprogress_displaychunk_t) { .type = CPROGRESS_DISPLAYCHUNK_UNKNOWN }))
     _cprogress_create_returnerror(CPROGRESS_ERROR_BUFFUL);
 
+  if (conversion_buf_length) {
+    cprogress.conversion_buf = (char *) CPROGRESS_MALLOC(conversion_buf_length);
+    if (!cprogress.conversion_buf) _cprogress_create_returnerror(CPROGRESS_ERROR_INTERNAL);
+  }
+
   return cprogress;
 }
 
 
-#define _cprogress_destroy_tryfree(v) if (v) { free(v); v = NULL; }
+/* view controller */
+void _cprogress_frame_flush(cprogress_t *cprogress);
+void _cprogress_drainlog(cprogress_t *cprogress);
+int _cprogress_pushevent(cprogress_t *cprogress, cprogress_event_type_t type, int task_index);
+int _cprogress_stoptask(cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo, int is_aborted);
+void _cprogress_history_sample(cprogress_t *cprogress);
+void _cprogress_display_observe(cprogress_taskinfo_t *taskinfo, int64_t now);
+
+#define _cprogress_destroy_tryfree(v) if (v) { CPROGRESS_FREE(v); v = NULL; }
 void cprogress_destroy(cprogress_t *cprogress) {
   if (cprogress) {
+    /* the stops below would wait on a queue nobody drains anymore */
+    cprogress->events_policy = CPROGRESS_EVENTS_DROP;
+    if (cprogress->pinned_row_count) cprogress_unpin(cprogress);
+    if (cprogress->log) {
+      /* those lines were meant to be seen */
+      _cprogress_drainlog(cprogress);
+      _cprogress_frame_flush(cprogress);
+      cprogress_mpsc_destroy(cprogress->log);
+      _cprogress_destroy_tryfree(cprogress->log);
+    }
+    if (cprogress->shared) cprogress_unshare(cprogress);
+    if (cprogress->ingest) cprogress_ingest_close(cprogress);
+    if (cprogress->tick) cprogress_tick_close(cprogress);
+    _cprogress_destroy_tryfree(cprogress->fmt);
     _cprogress_destroy_tryfree(cprogress->displaychunks);
+    _cprogress_destroy_tryfree(cprogress->conversion_buf);
+    _cprogress_destroy_tryfree(cprogress->display_heap);
     cprogress_stralloc_destroy(&cprogress->stralloc);
     if (cprogress->taskinfos) {
       cprogress_taskinfo_foreach(cprogress, taskinfo) {
-        cprogress_aborttask(cprogress, cprogress_taskinfo_getindex(taskinfo));
+        _cprogress_stoptask(cprogress, taskinfo, 1);
+        _cprogress_destroy_tryfree(taskinfo->title);
+        _cprogress_destroy_tryfree(taskinfo->history);
       }
       _cprogress_destroy_tryfree(cprogress->taskinfos);
+      for (int i = 0; i < CPROGRESS_TASKPAGE_MAXCOUNT; ++i)
+        _cprogress_destroy_tryfree(cprogress->taskpages[i]);
+    }
+    _cprogress_destroy_tryfree(cprogress->line_buf);
+    _cprogress_destroy_tryfree(cprogress->frame_buf);
+    if (cprogress->events) {
+      /* whatever is left is dropped, nobody is listening anymore */
+      cprogress_mpsc_destroy(cprogress->events);
+      _cprogress_destroy_tryfree(cprogress->events);
     }
   }
 }
@@ -844,45 +2522,295 @@ void cprogress_destroy(cprogress_t *cprogress) {
 | task controller
 ----------------------------------------------------------------------------*/
 
-void cprogress_starttask(cprogress_t *cprogress, int task_index) {
-  if (!cprogress || task_index < 0 || task_index >= cprogress->taskinfos_length) return;
-
-  cprogress_taskinfo_t *taskinfo = &cprogress_gettaskinfo(cprogress, task_index);
-  if (!taskinfo) return;
-
-  if (taskinfo->title) {
-    free(taskinfo->title);
+#define _cprogress_taskinfo_transit(taskinfo, expected, desired) \
+  __atomic_compare_exchange_n(&(taskinfo)->state, &(expected), desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+/* next frame has to be drawn, release so it sees what changed, and wake
+  the event loop if the last one was clean */
+void _cprogress_tick_markdirty(cprogress_t *cprogress);
+#define _cprogress_markdirty(cp) \
+  (cprogress_relaxed_load(&(cp)->tick)? _cprogress_tick_markdirty(cp): \
+    __atomic_store_n(&(cp)->is_dirty, 1, __ATOMIC_RELEASE))
+
+/* the lcm of the bar widths outgrew the cell bits of the key, so every
+  change counts as visible */
+#define _cprogress_visiblebar_toofine UINT32_MAX
+
+uint32_t _cprogress_visiblebar_lcm(uint32_t width, uint32_t bar_width) {
+  if (!bar_width || width == _cprogress_visiblebar_toofine) return width;
+  if (!width) return bar_width;
+
+  uint32_t a = width, b = bar_width;
+  while (b) {
+    uint32_t r = a % b;
+    a = b;
+    b = r;
   }
-  taskinfo->title = NULL;
-  taskinfo->percentage = 0;
-  taskinfo->is_just_started = 1;
-  taskinfo->is_just_stopped = 0;
-  taskinfo->is_running = 1;
+  uint64_t lcm = (uint64_t) width / a * bar_width;
+  return lcm > 0xffff? _cprogress_visiblebar_toofine: (uint32_t) lcm;
+}
 
-  cprogress_emitevent(cprogress, CPROGRESS_EVENT_THREADSTART, task_index);
+/* what [percentage] looks like, the bar cells of a bar as wide as the lcm
+  of those drawn, so a cell of any of them fills along with one of it, and
+  the digits if shown, computed like they are drawn */
+uint32_t _cprogress_visiblekey(cprogress_t *cprogress, float percentage) {
+  uint32_t bar_width = cprogress_relaxed_load(&cprogress->visible_bar_width);
+  if (bar_width == _cprogress_visiblebar_toofine) {
+    uint32_t key;
+    memcpy(&key, &percentage, sizeof(key));
+    return key;
+  }
+  uint32_t key = (uint32_t) (int) (bar_width * (percentage / 100.0));
+  if (cprogress->has_percentage_element)
+    key += (uint32_t) (percentage * 100 + 0.5f) << 16;
+  return key;
 }
 
-void cprogress_aborttask(cprogress_t *cprogress, int task_index) {
-  if (!cprogress || task_index < 0 || task_index >= cprogress->taskinfos_length) return;
+/* only worth a frame if it looks different */
+void _cprogress_touchtask(cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo, float percentage) {
+  uint32_t key = _cprogress_visiblekey(cprogress, percentage);
+  if (key == cprogress_relaxed_load(&taskinfo->visible_key)) return;
 
-  cprogress_taskinfo_t *taskinfo = &cprogress_gettaskinfo(cprogress, task_index);
-  if (!taskinfo) return;
+  cprogress_relaxed_store(&taskinfo->visible_key, key);
+  _cprogress_markdirty(cprogress);
+}
+
+/* starting a running task does nothing, stop it first */
+void _cprogress_starttask(cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo) {
+  int state = cprogress_relaxed_load(&taskinfo->state);
+  do {
+    int masked_state = state & CPROGRESS_TASK_STATEMASK;
+    if (masked_state == CPROGRESS_TASK_STARTING || masked_state == CPROGRESS_TASK_RUNNING) return;
+  } while (!_cprogress_taskinfo_transit(taskinfo, state, CPROGRESS_TASK_STARTING));
+
+  /* nobody updates it while starting */
+  cprogress_taskinfo_updatetitle(taskinfo, NULL);
+  cprogress_taskinfo_setpercentage(taskinfo, 0);
+  cprogress_relaxed_store(&taskinfo->visible_key, _cprogress_visiblekey(cprogress, 0));
+  __atomic_store_n(&taskinfo->state, CPROGRESS_TASK_RUNNING, __ATOMIC_RELEASE);
+  _cprogress_markdirty(cprogress);
+
+  cprogress_emitevent(cprogress, CPROGRESS_EVENT_THREADSTART, cprogress_taskinfo_getindex(taskinfo));
+}
 
-  taskinfo->is_running = 0;
-  taskinfo->is_just_started = 0;
-  taskinfo->is_just_stopped = 1;
-  /* let cprogress_taskinfo_start(...) and cprogress_abort(...) clean up everything
-    because cprogress_render(...) uses the data here */
+void cprogress_starttask(cprogress_t *cprogress, int task_index) {
+  if (!cprogress || task_index < 0 || task_index >= cprogress->taskinfos_length) return;
 
-  cprogress_emitevent(cprogress, CPROGRESS_EVENT_THREADSTOP, task_index);
+  _cprogress_starttask(cprogress, &cprogress_gettaskinfo(cprogress, task_index));
 }
 
+/* running -> finishing, returns zero if someone else stopped it first */
+int _cprogress_stoptask(cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo, int is_aborted) {
+  int state = CPROGRESS_TASK_RUNNING;
+  if (!_cprogress_taskinfo_transit(taskinfo, state,
+    CPROGRESS_TASK_FINISHING | (is_aborted? CPROGRESS_TASK_ABORTING: 0)))
+    return 0;
+  /* title and percentage stay for cprogress_render(...) to draw the last
+    line, cprogress_starttask(...) resets them */
+  _cprogress_markdirty(cprogress);
+
+  cprogress_emitevent(cprogress, CPROGRESS_EVENT_THREADSTOP, cprogress_taskinfo_getindex(taskinfo));
+  return 1;
+}
+
+/* finishing -> done or aborted, once its last line is drawn */
+void _cprogress_finalizetask(cprogress_taskinfo_t *taskinfo) {
+  int state = cprogress_relaxed_load(&taskinfo->state);
+  if ((state & CPROGRESS_TASK_STATEMASK) != CPROGRESS_TASK_FINISHING) return;
+  /* fails if restarted meanwhile, which is fine */
+  _cprogress_taskinfo_transit(taskinfo, state,
+    state & CPROGRESS_TASK_ABORTING? CPROGRESS_TASK_ABORTED: CPROGRESS_TASK_DONE);
+}
+
+void cprogress_aborttask(cprogress_t *cprogress, int task_index) {
+  if (!cprogress || task_index < 0 || task_index >= cprogress->taskinfos_length) return;
+
+  _cprogress_stoptask(cprogress, &cprogress_gettaskinfo(cprogress, task_index), 1);
+}
+
+/* acquired ones are left alone */
 void cprogress_startalltasks(cprogress_t *cprogress) {
   if (!cprogress) return;
 
-  cprogress_taskinfo_foreach(cprogress, taskinfo) {
-    cprogress_starttask(cprogress, cprogress_taskinfo_getindex(taskinfo));
+  for (int i = 0; i < cprogress->taskinfos_length; ++i)
+    cprogress_starttask(cprogress, i);
+}
+
+
+/* task slots
+  slot [n] is task [taskinfos_length + n], pages double in size so a slot
+  is found with a single bit scan */
+
+void _cprogress_taskslot_locate(size_t slot, int *page, size_t *offset) {
+  size_t page_position = slot / CPROGRESS_TASKPAGE_BASELENGTH + 1;
+  *page = 63 - __builtin_clzll((unsigned long long) page_position);
+  *offset = slot - (((size_t) 1 << *page) - 1) * CPROGRESS_TASKPAGE_BASELENGTH;
+}
+
+#define _cprogress_taskslot_pagelength(page) ((size_t) CPROGRESS_TASKPAGE_BASELENGTH << (page))
+
+/* NULL if its page isn't there (yet) */
+cprogress_taskinfo_t *_cprogress_taskslot_get(cprogress_t *cprogress, size_t slot) {
+  int page;
+  size_t offset;
+  _cprogress_taskslot_locate(slot, &page, &offset);
+  if (page >= CPROGRESS_TASKPAGE_MAXCOUNT) return NULL;
+
+  cprogress_taskinfo_t *taskpage = cprogress_atomic_load(&cprogress->taskpages[page]);
+  return taskpage? taskpage + offset: NULL;
+}
+
+cprogress_taskinfo_t *_cprogress_taskslot_alloc(cprogress_t *cprogress, size_t slot) {
+  int page;
+  size_t offset;
+  _cprogress_taskslot_locate(slot, &page, &offset);
+  if (page >= CPROGRESS_TASKPAGE_MAXCOUNT) return NULL;
+
+  cprogress_taskinfo_t *taskpage = cprogress_atomic_load(&cprogress->taskpages[page]);
+  if (!taskpage) {
+    size_t page_length = _cprogress_taskslot_pagelength(page);
+    cprogress_taskinfo_t *new_taskpage = (cprogress_taskinfo_t *) CPROGRESS_MALLOC(page_length * sizeof(cprogress_taskinfo_t));
+    if (!new_taskpage) return NULL;
+
+    memset(new_taskpage, 0, page_length * sizeof(cprogress_taskinfo_t));
+    size_t first_index = cprogress->taskinfos_length + (slot - offset);
+    for (size_t i = 0; i < page_length; ++i)
+      new_taskpage[i].task_index = (int) (first_index + i);
+
+    /* someone else may have needed the same page */
+    if (__atomic_compare_exchange_n(&cprogress->taskpages[page], &taskpage, new_taskpage,
+      0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      taskpage = new_taskpage;
+    else
+      CPROGRESS_FREE(new_taskpage);
+  }
+
+  return taskpage + offset;
+}
+
+/* the free list is a stack, its head is tagged so that a slot popped and
+  pushed back meanwhile doesn't fool a compare and swap */
+
+void _cprogress_taskslot_pushfree(cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo) {
+  uint32_t slot = (uint32_t) (cprogress_taskinfo_getindex(taskinfo) - cprogress->taskinfos_length);
+  uint64_t head = cprogress_relaxed_load(&cprogress->taskslots_freehead);
+  uint64_t new_head;
+  do {
+    cprogress_relaxed_store(&taskinfo->next_free_slot, (uint32_t) head);
+    new_head = ((head >> 32) + 1) << 32 | (slot + 1);
+  } while (!__atomic_compare_exchange_n(&cprogress->taskslots_freehead, &head, new_head,
+    1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+cprogress_taskinfo_t *_cprogress_taskslot_popfree(cprogress_t *cprogress) {
+  uint64_t head = cprogress_atomic_load(&cprogress->taskslots_freehead);
+  cprogress_taskinfo_t *taskinfo;
+  uint64_t new_head;
+  do {
+    uint32_t slot = (uint32_t) head;
+    if (!slot) return NULL;
+
+    /* never freed, so safe to peek even if it was popped meanwhile */
+    taskinfo = _cprogress_taskslot_get(cprogress, slot - 1);
+    new_head = ((head >> 32) + 1) << 32 | cprogress_relaxed_load(&taskinfo->next_free_slot);
+  } while (!__atomic_compare_exchange_n(&cprogress->taskslots_freehead, &head, new_head,
+    1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+  return taskinfo;
+}
+
+cprogress_taskinfo_t *cprogress_findtaskinfo(cprogress_t *cprogress, int task_index) {
+  if (!cprogress || task_index < 0) return NULL;
+  if ((size_t) task_index < cprogress->taskinfos_length) return &cprogress_gettaskinfo(cprogress, task_index);
+
+  size_t slot = task_index - cprogress->taskinfos_length;
+  if (slot >= cprogress_relaxed_load(&cprogress->taskslots_length)) return NULL;
+  return _cprogress_taskslot_get(cprogress, slot);
+}
+
+cprogress_taskinfo_t *cprogress_taskinfo_nextslot(cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo) {
+  size_t slot = 0;
+  if (taskinfo && cprogress_taskinfo_getindex(taskinfo) >= cprogress->taskinfos_length)
+    slot = cprogress_taskinfo_getindex(taskinfo) - cprogress->taskinfos_length + 1;
+
+  size_t slots_length = cprogress_atomic_load(&cprogress->taskslots_length);
+  while (slot < slots_length) {
+    cprogress_taskinfo_t *next = _cprogress_taskslot_get(cprogress, slot);
+    if (next) return next;
+
+    /* not allocated, skip the whole page */
+    int page;
+    size_t offset;
+    _cprogress_taskslot_locate(slot, &page, &offset);
+    if (page >= CPROGRESS_TASKPAGE_MAXCOUNT) break;
+    slot += _cprogress_taskslot_pagelength(page) - offset;
+  }
+
+  return NULL;
+}
+
+/* NULL if released meanwhile */
+cprogress_taskinfo_t *_cprogress_task_resolve(cprogress_taskhandle_t task) {
+  if (!task.cprogress || task.index < (int) task.cprogress->taskinfos_length) return NULL;
+
+  cprogress_taskinfo_t *taskinfo = _cprogress_taskslot_get(task.cprogress, task.index - task.cprogress->taskinfos_length);
+  if (!taskinfo || cprogress_relaxed_load(&taskinfo->generation) != task.generation) return NULL;
+  return taskinfo;
+}
+
+cprogress_taskhandle_t cprogress_task_acquire(cprogress_t *cprogress) {
+  cprogress_taskhandle_t task = {};
+  if (!cprogress) return task;
+
+  cprogress_taskinfo_t *taskinfo = _cprogress_taskslot_popfree(cprogress);
+  /* the page is there before the slot is claimed, so past the last page or
+    out of memory no slot is left behind */
+  size_t slot = cprogress_atomic_load(&cprogress->taskslots_length);
+  while (!taskinfo) {
+    taskinfo = _cprogress_taskslot_alloc(cprogress, slot);
+    if (!taskinfo) return task;
+    if (!__atomic_compare_exchange_n(&cprogress->taskslots_length, &slot, slot + 1,
+      1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      taskinfo = NULL;
   }
+
+  task.cprogress = cprogress;
+  task.index = cprogress_taskinfo_getindex(taskinfo);
+  task.generation = cprogress_relaxed_load(&taskinfo->generation);
+  return task;
+}
+
+void cprogress_task_release(cprogress_taskhandle_t task) {
+  cprogress_taskinfo_t *taskinfo = _cprogress_task_resolve(task);
+  if (!taskinfo) return;
+
+  /* only one release per acquire gets through */
+  uint32_t generation = task.generation;
+  if (!__atomic_compare_exchange_n(&taskinfo->generation, &generation, generation + 1,
+    0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    return;
+
+  _cprogress_stoptask(task.cprogress, taskinfo, 1);
+  _cprogress_taskslot_pushfree(task.cprogress, taskinfo);
+}
+
+int cprogress_task_isvalid(cprogress_taskhandle_t task) {
+  return _cprogress_task_resolve(task) != NULL;
+}
+
+int cprogress_task_isrunning(cprogress_taskhandle_t task) {
+  cprogress_taskinfo_t *taskinfo = _cprogress_task_resolve(task);
+  return taskinfo && cprogress_taskinfo_isrunning(taskinfo);
+}
+
+void cprogress_task_start(cprogress_taskhandle_t task) {
+  cprogress_taskinfo_t *taskinfo = _cprogress_task_resolve(task);
+  if (taskinfo) _cprogress_starttask(task.cprogress, taskinfo);
+}
+
+void cprogress_task_abort(cprogress_taskhandle_t task) {
+  cprogress_taskinfo_t *taskinfo = _cprogress_task_resolve(task);
+  if (taskinfo) _cprogress_stoptask(task.cprogress, taskinfo, 1);
 }
 
 
@@ -984,11 +2912,160 @@ size_t cprogress_writeprogressbar(char *buf, size_t buf_len, char fill_char, flo
 }
 
 
+/* the last [alloc_width] samples of [taskinfo], scaled to the highest of
+  them, blank without a task */
+size_t _cprogress_writesparkline(char *buf, size_t buf_len, cprogress_taskinfo_t *taskinfo, size_t history_length, size_t alloc_width) {
+  static const char *levels[] = { "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█" };
+
+  size_t count = 0;
+  if (taskinfo && taskinfo->history) {
+    count = taskinfo->history_count < history_length? taskinfo->history_count: history_length;
+    if (count > alloc_width) count = alloc_width;
+  }
+  size_t first = taskinfo? taskinfo->history_count - count: 0;
+
+  unsigned max = 0;
+  for (size_t i = 0; i < count; ++i) {
+    unsigned sample = taskinfo->history[(first + i) % history_length];
+    if (sample > max) max = sample;
+  }
+
+  size_t written_length = 0;
+  for (size_t i = count; i < alloc_width && written_length < buf_len; ++i)
+    buf[written_length++] = ' ';
+  for (size_t i = 0; i < count; ++i) {
+    unsigned sample = taskinfo->history[(first + i) % history_length];
+    const char *ch = " ";
+    if (sample) ch = levels[(sample * 8 - 1) / max];
+
+    size_t char_length = strlen(ch);
+    if (written_length + char_length > buf_len) break;
+    memcpy(buf + written_length, ch, char_length);
+    written_length += char_length;
+  }
+
+  return written_length;
+}
+
+
+/* only what differs between [from] and [to], cprogress_style_t both */
+size_t _cprogress_writesgr(char *buf, size_t buf_len, int from, int to) {
+  if (from == to) return 0;
+
+  char sgr[CPROGRESS_STYLE_SGRMAXLEN];
+  size_t length = 0;
+  #define _cprogress_writesgr_add(param) length += snprintf(sgr + length, sizeof(sgr) - length, "%d;", param)
+  if (!to) {
+    length = snprintf(sgr, sizeof(sgr), "\x1b[m");
+  } else {
+    length = snprintf(sgr, sizeof(sgr), "\x1b[");
+    int off = from & ~to & CPROGRESS_STYLE_ATTRMASK;
+    int on = to & ~from & CPROGRESS_STYLE_ATTRMASK;
+    /* bold and dim go off together */
+    if (off & (CPROGRESS_STYLE_BOLD | CPROGRESS_STYLE_DIM)) {
+      _cprogress_writesgr_add(22);
+      on |= to & (CPROGRESS_STYLE_BOLD | CPROGRESS_STYLE_DIM);
+    }
+    if (off & CPROGRESS_STYLE_ITALIC) _cprogress_writesgr_add(23);
+    if (off & CPROGRESS_STYLE_UNDERLINE) _cprogress_writesgr_add(24);
+    if (on & CPROGRESS_STYLE_BOLD) _cprogress_writesgr_add(1);
+    if (on & CPROGRESS_STYLE_DIM) _cprogress_writesgr_add(2);
+    if (on & CPROGRESS_STYLE_ITALIC) _cprogress_writesgr_add(3);
+    if (on & CPROGRESS_STYLE_UNDERLINE) _cprogress_writesgr_add(4);
+
+    int color = to & CPROGRESS_STYLE_COLORMASK;
+    if (color != (from & CPROGRESS_STYLE_COLORMASK))
+      _cprogress_writesgr_add(!color? 39: color <= 8? 30 + color - 1: 90 + color - 9);
+    sgr[length - 1] = 'm';
+  }
+  #undef _cprogress_writesgr_add
+
+  if (length > buf_len) return 0;
+  memcpy(buf, sgr, length);
+  return length;
+}
+
+/* the color [taskinfo] stands for, zero to keep the one given */
+int _cprogress_statecolor(cprogress_taskinfo_t *taskinfo, int64_t now) {
+  if (!taskinfo) return 0;
+
+  int state = __atomic_load_n(&taskinfo->state, __ATOMIC_ACQUIRE);
+  int masked_state = state & CPROGRESS_TASK_STATEMASK;
+  if (masked_state == CPROGRESS_TASK_ABORTED || (state & CPROGRESS_TASK_ABORTING)) return 2; /* red */
+  if (masked_state == CPROGRESS_TASK_FINISHING || masked_state == CPROGRESS_TASK_DONE) return 3; /* green */
+  if (taskinfo->display_change_ns && now - taskinfo->display_change_ns >= CPROGRESS_STYLE_STALL_MS * 1000000LL)
+    return 2;
+  return 0;
+}
+
+/* left out to write less, see SLOW TERMINALS */
+#define _cprogress_isdropped(cp, displaychunk) \
+  ((cp)->detail_level >= CPROGRESS_DETAIL_MINIMAL && \
+    ((displaychunk)->type == CPROGRESS_DISPLAYCHUNK_SPARKLINE || (displaychunk)->type == CPROGRESS_DISPLAYCHUNK_CUSTOM))
+
+/* columns taken by utf-8 [buf], as if each took one */
+size_t _cprogress_measureutf8(const char *buf, size_t len) {
+  size_t width = 0;
+  for (size_t i = 0; i < len; ++i)
+    width += (buf[i] & 0xc0) != 0x80;
+  return width;
+}
+
+/* the bytes of [buf] that fit in [width] columns, counted the same way */
+size_t _cprogress_fitutf8(const char *buf, size_t len, size_t width) {
+  size_t i = 0;
+  for (size_t columns = 0; i < len; ++i) {
+    if ((buf[i] & 0xc0) != 0x80 && columns++ == width) break;
+  }
+  return i;
+}
+
+/* by its contract, or by drawing it aside */
+size_t _cprogress_measureconversion(cprogress_t *cprogress, cprogress_displaychunk_t *displaychunk) {
+  if (displaychunk->span_width != CPROGRESS_UNDEF) return displaychunk->span_width;
+
+  cprogress_conversion_t *conversion = &displaychunk->conversion;
+  if (conversion->width_type == CPROGRESS_CONVERSION_FIXEDWIDTH) return conversion->width;
+
+  char *buf = cprogress->conversion_buf + displaychunk->conversion_offset;
+  size_t buf_len = _cprogress_printline_widthtolength(conversion->width);
+  size_t length = conversion->func(buf, buf_len, conversion->width, cprogress, cprogress->line_taskinfo, conversion->userdata);
+  if (length > buf_len) length = buf_len;
+  displaychunk->conversion_length = length;
+
+  size_t width = _cprogress_measureutf8(buf, length);
+  return width < conversion->width? width: conversion->width;
+}
+
+size_t _cprogress_writeconversion(cprogress_t *cprogress, cprogress_displaychunk_t *displaychunk, char *buf, size_t buf_len, size_t alloc_width) {
+  cprogress_conversion_t *conversion = &displaychunk->conversion;
+
+  size_t length;
+  if (conversion->width_type == CPROGRESS_CONVERSION_MAXWIDTH &&
+    displaychunk->span_width == CPROGRESS_UNDEF && !displaychunk->is_autospan) {
+    /* drawn already */
+    length = displaychunk->conversion_length < buf_len? displaychunk->conversion_length: buf_len;
+    memcpy(buf, cprogress->conversion_buf + displaychunk->conversion_offset, length);
+  } else {
+    length = conversion->func(buf, buf_len, alloc_width, cprogress, cprogress->line_taskinfo, conversion->userdata);
+    if (length > buf_len) length = buf_len;
+  }
+  /* whatever it wrote past its columns would wrap the line */
+  length = _cprogress_fitutf8(buf, length, alloc_width);
+
+  for (size_t width = _cprogress_measureutf8(buf, length); width < alloc_width && length < buf_len; ++width)
+    buf[length++] = ' ';
+  return length;
+}
+
+
 void cprogress_writeline(cprogress_t *cprogress, char *buf, size_t buf_len, size_t console_width, const char *title, float percentage) {
 
   char *line = buf;
   if (!line || console_width <= 1) return;
 
+  cprogress_stats_begintimer(writeline_begin);
+
   char percentage_string[7] = {};
   cprogress_sprintpercentage(percentage_string, 6, percentage);
 
@@ -996,6 +3073,10 @@ void cprogress_writeline(cprogress_t *cprogress, char *buf, size_t buf_len, size
 
   size_t taken_display_width = 0;
   cprogress_displaychunk_foreach(cprogress, displaychunk) {
+    if (_cprogress_isdropped(cprogress, displaychunk)) {
+      displaychunk->display_width = 0;
+      continue;
+    }
     if (!displaychunk->is_autospan) {
       size_t display_width = 0;
       switch (displaychunk->type) {
@@ -1006,8 +3087,12 @@ void cprogress_writeline(cprogress_t *cprogress, char *buf, size_t buf_len, size
           display_width = cprogress_measuredisplaychunk(displaychunk, title, CPROGRESS_UNDEF);
           break;
         case CPROGRESS_DISPLAYCHUNK_BAR:
+        case CPROGRESS_DISPLAYCHUNK_SPARKLINE:
           display_width = cprogress_measuredisplaychunk(displaychunk, NULL, CPROGRESS_UNDEF);
           break;
+        case CPROGRESS_DISPLAYCHUNK_CUSTOM:
+          display_width = _cprogress_measureconversion(cprogress, displaychunk);
+          break;
         case CPROGRESS_DISPLAYCHUNK_PERCENTAGE:
           display_width = cprogress_measuredisplaychunk(displaychunk, percentage_string, CPROGRESS_UNDEF);
           break;
@@ -1021,12 +3106,39 @@ void cprogress_writeline(cprogress_t *cprogress, char *buf, size_t buf_len, size
     console_width - taken_display_width:
     0;
 
+  /* for _cprogress_visiblekey(...) */
+  cprogress_displaychunk_foreach(cprogress, displaychunk) {
+    if (displaychunk->type == CPROGRESS_DISPLAYCHUNK_BAR) {
+      size_t bar_width = displaychunk->is_autospan? autospan_width: displaychunk->display_width;
+      if (bar_width > 0xffff) bar_width = _cprogress_visiblebar_toofine;
+      cprogress->frame_bar_width = _cprogress_visiblebar_lcm(cprogress->frame_bar_width, (uint32_t) bar_width);
+    }
+  }
+
   /* actual render */
 
+  int64_t now = cprogress->has_statestyle? cprogress_nanotime(): 0;
+  int sgr_style = 0; /* the terminal's, lines start and end unstyled */
+
   char *ptr = line;
   size_t avail_length = buf_len;
   cprogress_displaychunk_foreach(cprogress, displaychunk) {
     if (avail_length <= 0) break;
+    if (_cprogress_isdropped(cprogress, displaychunk)) continue;
+
+    if (cprogress->style_mask) {
+      int style = displaychunk->style;
+      if (style & CPROGRESS_STYLE_BYSTATE) {
+        int color = _cprogress_statecolor(cprogress->line_taskinfo, now);
+        if (color) style = (style & ~CPROGRESS_STYLE_COLORMASK) | color;
+      }
+      style &= cprogress->style_mask;
+
+      size_t sgr_length = _cprogress_writesgr(ptr, avail_length, sgr_style, style);
+      ptr += sgr_length;
+      avail_length -= sgr_length;
+      sgr_style = style;
+    }
 
     size_t display_width = displaychunk->is_autospan? autospan_width: displaychunk->display_width;
     if (display_width == CPROGRESS_UNDEF) {
@@ -1048,11 +3160,22 @@ void cprogress_writeline(cprogress_t *cprogress, char *buf, size_t buf_len, size
       case CPROGRESS_DISPLAYCHUNK_PERCENTAGE:
         print_length = cprogress_writeliteral(ptr, avail_length, percentage_string, display_width);
         break;
+      case CPROGRESS_DISPLAYCHUNK_SPARKLINE:
+        print_length = _cprogress_writesparkline(ptr, avail_length, cprogress->line_taskinfo, cprogress->history_length, display_width);
+        break;
+      case CPROGRESS_DISPLAYCHUNK_CUSTOM:
+        print_length = _cprogress_writeconversion(cprogress, displaychunk, ptr, avail_length, display_width);
+        break;
     }
 
     ptr += print_length;
     avail_length -= print_length;
   }
+
+  if (sgr_style) _cprogress_writesgr(ptr, avail_length, sgr_style, 0);
+
+  cprogress_stats_add(cprogress->stats.writeline_count, 1);
+  cprogress_stats_endtimer(cprogress->stats.writeline_ns, writeline_begin);
 }
 
 
@@ -1060,29 +3183,139 @@ void cprogress_writeline(cprogress_t *cprogress, char *buf, size_t buf_len, size
 | view controller
 ----------------------------------------------------------------------------*/
 
-#define _cprogress_printline_widthtolength(width) (width * 4 + 1)
+void _cprogress_frame_reserve(cprogress_t *cprogress, size_t len) {
+  if (cprogress->frame_length + len <= cprogress->frame_size) return;
+
+  size_t frame_size = cprogress->frame_size? cprogress->frame_size: 4096;
+  while (frame_size < cprogress->frame_length + len) frame_size *= 2;
+
+  char *frame_buf = (char *) CPROGRESS_REALLOC(cprogress->frame_buf, frame_size);
+  if (!frame_buf)
+    cprogress_panic("failed to alloc memory to store a frame");
+  cprogress->frame_buf = frame_buf;
+  cprogress->frame_size = frame_size;
+}
+
+void _cprogress_frame_write(cprogress_t *cprogress, const char *data, size_t len) {
+  _cprogress_frame_reserve(cprogress, len);
+  memcpy(cprogress->frame_buf + cprogress->frame_length, data, len);
+  cprogress->frame_length += len;
+}
+
+#define _cprogress_frame_writestr(cprogress, str) _cprogress_frame_write(cprogress, str, sizeof(str) - 1)
+
+/* only for short control sequences */
+void _cprogress_frame_printf(cprogress_t *cprogress, const char *fmt, ...) {
+  char seq[64];
+  va_list va;
+  va_start(va, fmt);
+  int len = vsnprintf(seq, sizeof(seq), fmt, va);
+  va_end(va);
+  if (len > 0) _cprogress_frame_write(cprogress, seq, len < (int) sizeof(seq)? len: sizeof(seq) - 1);
+}
+
+/* same as cprogress_console_moverel(...), but into the frame, and the
+  count is left out when it's 1 */
+void _cprogress_frame_moverel(cprogress_t *cprogress, short x, short y) {
+  char seq[32];
+  size_t len = 0;
+  if (x == 1) len += sprintf(seq + len, "\x1b[C");
+  else if (x == -1) len += sprintf(seq + len, "\x1b[D");
+  else if (x > 0) len += sprintf(seq + len, "\x1b[%dC", x);
+  else if (x < 0) len += sprintf(seq + len, "\x1b[%dD", -x);
+  if (y == 1) len += sprintf(seq + len, "\x1b[B");
+  else if (y == -1) len += sprintf(seq + len, "\x1b[A");
+  else if (y > 0) len += sprintf(seq + len, "\x1b[%dB", y);
+  else if (y < 0) len += sprintf(seq + len, "\x1b[%dA", -y);
+  _cprogress_frame_write(cprogress, seq, len);
+}
+
+/* back to the first column and clear the line */
+void _cprogress_frame_resetline(cprogress_t *cprogress) {
+  if (cprogress->termcaps & CPROGRESS_TERMCAP_ANSI)
+    _cprogress_frame_writestr(cprogress, "\r\x1b[K");
+  else
+    _cprogress_frame_writestr(cprogress, "\r");
+}
+
+/* write the frame out in one go */
+void _cprogress_frame_flush(cprogress_t *cprogress) {
+  if (!cprogress->frame_length) {
+    cprogress_stats_add(cprogress->stats.skipped_frame_count, 1);
+    return;
+  }
 
+  int64_t write_begin = cprogress_nanotime();
+  int write_count = cprogress_console_write(cprogress->frame_buf, cprogress->frame_length);
+  cprogress->last_write_ns = cprogress_nanotime() - write_begin;
+  cprogress_stats_add(cprogress->stats.frame_count, 1);
+  cprogress_stats_add(cprogress->stats.emitted_bytes, cprogress->frame_length);
+  cprogress_stats_add(cprogress->stats.write_count, write_count);
+  (void) write_count;
 
+  cprogress->frame_length = 0;
+}
+
+/* move queued log lines into the frame */
+void _cprogress_drainlog(cprogress_t *cprogress) {
+  if (!cprogress->log) return;
+
+  uint64_t self = cprogress_thread_self();
+  if (self != cprogress_relaxed_load(&cprogress->log_thread))
+    cprogress_relaxed_store(&cprogress->log_thread, self);
+
+  cprogress_logrecord_t record;
+  while (cprogress_mpsc_trypop(cprogress->log, &record)) {
+    _cprogress_markdirty(cprogress); /* the line goes over the bars */
+    /* pinned bars are out of the way */
+    if (!cprogress->pinned_row_count)
+      _cprogress_frame_resetline(cprogress);
+    _cprogress_frame_write(cprogress, record.line, strlen(record.line));
+    _cprogress_frame_writestr(cprogress, "\n");
+  }
+}
+
+
+/* everything sized by the console width is rebuilt here */
 void cprogress_updatelinebuffer(cprogress_t *cprogress, int console_width) {
   if (console_width == CPROGRESS_UNDEF) return;
 
-  size_t buf_len = _cprogress_printline_widthtolength(console_width);
+  size_t buf_len = _cprogress_printline_buflength(console_width);
 
   cprogress->line_buf = cprogress->line_buf?
-    realloc(cprogress->line_buf, buf_len):
-    malloc(buf_len);
+    CPROGRESS_REALLOC(cprogress->line_buf, buf_len):
+    CPROGRESS_MALLOC(buf_len);
 
   if (!cprogress->line_buf)
     cprogress_panic("failed to alloc memory to store line chars");
 
   cprogress->console_width = console_width;
+  _cprogress_markdirty(cprogress);
 }
 
 void cprogress_autoupdateconsolewidth(cprogress_t *cprogress, int console_width) {
-  if (console_width == CPROGRESS_UNDEF &&
-    cprogress->keep_consolewidth_loopcount >= CPROGRESS_CONSOLE_UPDATEWIDTH_LOOPCOUNT ||
-    cprogress->console_width == CPROGRESS_UNDEF) {
+  int is_stale = cprogress->console_width == CPROGRESS_UNDEF;
+
+  if (console_width == CPROGRESS_UNDEF) {
+    int generation = cprogress_console_getwidthgeneration();
+    if (generation == CPROGRESS_UNDEF) {
+      /* can't tell when it's resized, ask every now and then */
+      is_stale = is_stale || cprogress->keep_consolewidth_loopcount >= CPROGRESS_CONSOLE_UPDATEWIDTH_LOOPCOUNT;
+    } else {
+      is_stale = is_stale || generation != cprogress->consolewidth_generation;
+      cprogress->consolewidth_generation = generation;
+    }
+  } else {
+    /* ask again once it's no longer given */
+    cprogress->consolewidth_generation = CPROGRESS_UNDEF;
+  }
+
+  if (is_stale) {
     console_width = cprogress_console_getwidth();
+    cprogress_stats_add(cprogress->stats.consolewidth_query_count, 1);
+    cprogress->keep_consolewidth_loopcount = 0;
+    if (cprogress->pinned_row_count)
+      cprogress->console_height = cprogress_console_getheight();
 
     if (console_width == CPROGRESS_UNDEF)
       cprogress_panic("failed to get console width");
@@ -1094,7 +3327,6 @@ void cprogress_autoupdateconsolewidth(cprogress_t *cprogress, int console_width)
   if (console_width != cprogress->console_width ||
     !cprogress->line_buf) {
     cprogress_updatelinebuffer(cprogress, console_width);
-    cprogress->keep_consolewidth_loopcount = 0;
   }
 
   ++cprogress->keep_consolewidth_loopcount;
@@ -1110,7 +3342,84 @@ void cprogress_beginrender_consolewidth(cprogress_t *cprogress, int console_widt
     cprogress_panic("you forgot to call cprogress_endrender(...)  or called cprogress_beginrender(...) twice");
 
   cprogress->is_rendering = 1;
+
+  /* have the terminal draw the frame at once */
+  if (cprogress->termcaps & CPROGRESS_TERMCAP_SYNC)
+    _cprogress_frame_writestr(cprogress, "\x1b[?2026h");
+  cprogress->frame_begin_length = cprogress->frame_length;
+
   cprogress_autoupdateconsolewidth(cprogress, console_width);
+
+  if (cprogress->pinned_row_count &&
+    cprogress->console_height != cprogress->pinned_console_height &&
+    cprogress->console_height > cprogress->pinned_row_count) {
+    /* resized, the rows to pin moved */
+    _cprogress_frame_printf(cprogress, "\x1b" "7" "\x1b[1;%dr" "\x1b" "8",
+      cprogress->console_height - cprogress->pinned_row_count);
+    cprogress->pinned_console_height = cprogress->console_height;
+    _cprogress_markdirty(cprogress);
+  }
+
+  /* the cursor is above the bars, so logs push them down */
+  _cprogress_drainlog(cprogress);
+}
+
+/* one step at a time, see SLOW TERMINALS */
+void _cprogress_adapt(cprogress_t *cprogress, int64_t write_ns) {
+  if (!cprogress->frame_budget_ns) return;
+
+  cprogress->frame_write_ns += (write_ns - cprogress->frame_write_ns) / 4;
+  ++cprogress->adapt_frame_count;
+  if (cprogress->adapt_frame_count < CPROGRESS_RENDER_ADAPTFRAMES) return;
+
+  if (cprogress->frame_write_ns > cprogress->frame_budget_ns) {
+    if (cprogress->fps_divisor < CPROGRESS_RENDER_MAXFPSDIVISOR) cprogress->fps_divisor *= 2;
+    else if (cprogress->detail_level < CPROGRESS_DETAIL_MINIMAL) ++cprogress->detail_level;
+    else return;
+    /* stepped up too early, be slower to try again */
+    if (cprogress->adapt_last_step > 0 && cprogress->adapt_backoff < CPROGRESS_RENDER_MAXADAPTBACKOFF)
+      ++cprogress->adapt_backoff;
+    cprogress->adapt_last_step = -1;
+  } else {
+    if (cprogress->adapt_frame_count < CPROGRESS_RENDER_ADAPTFRAMES << cprogress->adapt_backoff) return;
+    if (cprogress->frame_write_ns >= cprogress->frame_budget_ns / 4) return;
+
+    if (cprogress->detail_level > CPROGRESS_DETAIL_FULL) --cprogress->detail_level;
+    else if (cprogress->fps_divisor > 1) cprogress->fps_divisor /= 2;
+    else if (cprogress->adapt_backoff) --cprogress->adapt_backoff; /* it's been fine for a while */
+    cprogress->adapt_last_step = 1;
+  }
+
+  cprogress->adapt_frame_count = 0;
+  _cprogress_markdirty(cprogress);
+}
+
+int cprogress_setframebudget(cprogress_t *cprogress, long budget_ms) {
+  if (!cprogress || budget_ms < 0) return CPROGRESS_ERROR_INVAL;
+
+  cprogress->frame_budget_ns = budget_ms * 1000000LL;
+  if (!budget_ms) {
+    cprogress->fps_divisor = 1;
+    cprogress->detail_level = CPROGRESS_DETAIL_FULL;
+    _cprogress_markdirty(cprogress);
+  }
+  return CPROGRESS_ERROR_OK;
+}
+
+/* forget what happened since the last frame */
+void _cprogress_endframe(cprogress_t *cprogress) {
+  /* cprogress_render(...) finalizes the ones it drew, it must not miss
+    those stopped after it looked, other frames show no task lines */
+  if (!cprogress->has_rendered_tasks) {
+    cprogress_taskinfo_foreach(cprogress, taskinfo)
+      _cprogress_finalizetask(taskinfo);
+  }
+  cprogress->has_rendered_tasks = 0;
+
+  /* updaters quantize to what was drawn */
+  if (cprogress->frame_bar_width && cprogress->frame_bar_width != cprogress->visible_bar_width)
+    cprogress_relaxed_store(&cprogress->visible_bar_width, cprogress->frame_bar_width);
+  cprogress->frame_bar_width = 0;
 }
 
 void cprogress_endrender(cprogress_t *cprogress) {
@@ -1118,19 +3427,26 @@ void cprogress_endrender(cprogress_t *cprogress) {
   if (!cprogress->is_rendering)
     cprogress_panic("you forgot to call cprogress_beginrender(...) or called cprogress_endrender(...) twice");
 
-  cprogress_taskinfo_foreach(cprogress, taskinfo) {
-    taskinfo->is_just_started = 0;
-    taskinfo->is_just_stopped = 0;
-  }
+  int is_empty = cprogress->frame_length == cprogress->frame_begin_length;
+  if (is_empty)
+    cprogress->frame_length = 0; /* nothing to draw */
+  else if (cprogress->termcaps & CPROGRESS_TERMCAP_SYNC)
+    _cprogress_frame_writestr(cprogress, "\x1b[?2026l");
+
+  _cprogress_frame_flush(cprogress);
+  if (!is_empty) _cprogress_adapt(cprogress, cprogress->last_write_ns);
+  _cprogress_endframe(cprogress);
 
   cprogress->is_rendering = 0;
+
+  cprogress_flushevents(cprogress);
 }
 
 
 void cprogress_abort(cprogress_t *cprogress) {
   if (!cprogress) return;
 
-  cprogress->is_running = 0;
+  cprogress_relaxed_store(&cprogress->is_running, 0);
 }
 
 int cprogress_stillrunning(cprogress_t *cprogress) {
@@ -1138,7 +3454,8 @@ int cprogress_stillrunning(cprogress_t *cprogress) {
 
   int is_all_finished = 1;
   cprogress_taskinfo_foreach(cprogress, taskinfo) {
-    if (taskinfo->is_running || taskinfo->is_just_stopped) {
+    int state = cprogress_taskinfo_getstate(taskinfo);
+    if (state == CPROGRESS_TASK_STARTING || state == CPROGRESS_TASK_RUNNING || state == CPROGRESS_TASK_FINISHING) {
       is_all_finished = 0;
       break;
     }
@@ -1146,29 +3463,49 @@ int cprogress_stillrunning(cprogress_t *cprogress) {
 
   if (is_all_finished) cprogress_abort(cprogress);
 
-  if (!cprogress->is_running) {
+  int is_running = cprogress_relaxed_load(&cprogress->is_running);
+  if (!is_running) {
     for (int i = 0; i < cprogress->last_alive_task_count; ++i)
-      puts("");
-    cprogress_emitevent(cprogress, CPROGRESS_EVENT_STOP, CPROGRESS_UNDEF);
+      _cprogress_frame_writestr(cprogress, "\n");
+    cprogress->last_alive_task_count = 0;
+    _cprogress_drainlog(cprogress);
+    if (cprogress->pinned_row_count) cprogress_unpin(cprogress);
+    if (!cprogress->is_rendering) _cprogress_frame_flush(cprogress);
+    cprogress_flushevents(cprogress);
+    /* this is the render thread, so a full queue is emptied rather than
+      waited on */
+    while (!_cprogress_pushevent(cprogress, CPROGRESS_EVENT_STOP, CPROGRESS_UNDEF))
+      cprogress_flushevents(cprogress);
+    cprogress_flushevents(cprogress);
   }
 
-  return cprogress->is_running;
+  return is_running;
 }
 
 
-void cprogress_printline(cprogress_t *cprogress, const char *title, float percentage) {
-  if (!cprogress) return;
-
+/* compose a line into cprogress->line_buf */
+void _cprogress_fillline(cprogress_t *cprogress, const char *title, float percentage) {
   int console_width = cprogress->console_width;
   --console_width; /* give a space for cursor */
   char *buf = cprogress->line_buf;
-  size_t buf_len = _cprogress_printline_widthtolength(console_width);
+  size_t buf_len = _cprogress_printline_buflength(console_width);
 
   memset(buf, 0, buf_len);
-  printf(" "); /* space for cursor */
   cprogress_writeline(cprogress, buf, buf_len, console_width, title, percentage);
-  printf("%s", buf);
-  fflush(stdout);
+}
+
+void _cprogress_flushline(cprogress_t *cprogress) {
+  _cprogress_frame_writestr(cprogress, " "); /* space for cursor */
+  _cprogress_frame_write(cprogress, cprogress->line_buf, strlen(cprogress->line_buf));
+}
+
+/* goes into the frame while rendering, or straight to the console */
+void cprogress_printline(cprogress_t *cprogress, const char *title, float percentage) {
+  if (!cprogress) return;
+
+  _cprogress_fillline(cprogress, title, percentage);
+  _cprogress_flushline(cprogress);
+  if (!cprogress->is_rendering) _cprogress_frame_flush(cprogress);
 }
 
 
@@ -1178,136 +3515,1927 @@ void cprogress_renderline(cprogress_t *cprogress, const char *title, float perce
   if (!cprogress->is_rendering)
     cprogress_panic("you forget to call cprogress_beginrender(...)");
 
-  cprogress_console_resetline();
-  cprogress_console_eraseline();
+  _cprogress_frame_resetline(cprogress);
   cprogress_printline(cprogress, title, percentage);
 }
 
-void cprogress_render(cprogress_t *cprogress) {
-  if (!cprogress) return;
+/* like _cprogress_fillline(...), but the title may be changed meanwhile */
+void _cprogress_filltask(cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo) {
+  float percentage = cprogress_taskinfo_getpercentage(taskinfo);
+  /* to tell whether it stalls */
+  if (cprogress->has_statestyle && cprogress_taskinfo_isrunning(taskinfo))
+    _cprogress_display_observe(taskinfo, cprogress_nanotime());
+  cprogress->line_taskinfo = taskinfo;
+  cprogress_taskinfo_locktitle(taskinfo);
+  _cprogress_fillline(cprogress, taskinfo->title, percentage);
+  cprogress_taskinfo_unlocktitle(taskinfo);
+  cprogress->line_taskinfo = NULL;
+}
 
-  /* count how many tasks are alive */
-  int alive_task_count = 0;
-  cprogress_taskinfo_foreach(cprogress, taskinfo) {
-    if (taskinfo->is_running)
-      ++alive_task_count;
-  }
+/* like cprogress_renderline(...), but the title may be changed meanwhile */
+void _cprogress_rendertask(cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo) {
+  if (!cprogress->is_rendering)
+    cprogress_panic("you forget to call cprogress_beginrender(...)");
 
-  cprogress_taskinfo_foreach(cprogress, taskinfo) {
-    if (taskinfo->is_just_stopped) {
-      cprogress_renderline(cprogress, taskinfo->title, taskinfo->percentage);
-      puts(""); /* move to next line */
+  _cprogress_filltask(cprogress, taskinfo);
+  _cprogress_frame_resetline(cprogress);
+  _cprogress_flushline(cprogress);
+}
+
+/* display policy
+  a max-heap of the [row_count] lowest keys seen so far, the root is the
+  first to go when a lower one comes */
+
+float _cprogress_display_key(cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo, int64_t now) {
+  switch (cprogress->display_policy) {
+    case CPROGRESS_DISPLAY_LOWESTPROGRESS:
+      return taskinfo->display_percentage;
+    case CPROGRESS_DISPLAY_LOWESTRATE: {
+      /* no news is slow news */
+      int64_t stalled_ns = now - taskinfo->display_change_ns;
+      return taskinfo->display_rate * CPROGRESS_DISPLAY_RATEHALFLIFE_NS /
+        (float) (CPROGRESS_DISPLAY_RATEHALFLIFE_NS + stalled_ns);
     }
+    case CPROGRESS_DISPLAY_STALEST:
+      return (float) (taskinfo->display_change_ns - now);
+    default:
+      return (float) cprogress_taskinfo_getindex(taskinfo);
   }
+}
 
-  cprogress_taskinfo_foreach(cprogress, taskinfo) {
-    if (taskinfo->is_running) {
-      cprogress_renderline(cprogress, taskinfo->title, taskinfo->percentage);
-      puts(""); /* move to next line */
-    }
+/* ties go to the lower index, so the choice doesn't flicker */
+#define _cprogress_display_isbefore(a, b) \
+  ((a).key < (b).key || ((a).key == (b).key && \
+    cprogress_taskinfo_getindex((a).taskinfo) < cprogress_taskinfo_getindex((b).taskinfo)))
+
+void _cprogress_display_siftdown(cprogress_displayentry_t *heap, size_t heap_length) {
+  size_t i = 0;
+  while (1) {
+    size_t largest = i, left = 2 * i + 1, right = left + 1;
+    if (left < heap_length && _cprogress_display_isbefore(heap[largest], heap[left])) largest = left;
+    if (right < heap_length && _cprogress_display_isbefore(heap[largest], heap[right])) largest = right;
+    if (largest == i) return;
+
+    cprogress_displayentry_t entry = heap[i];
+    heap[i] = heap[largest];
+    heap[largest] = entry;
+    i = largest;
   }
+}
 
-  cprogress->last_alive_task_count = alive_task_count;
+void _cprogress_display_siftup(cprogress_displayentry_t *heap, size_t i) {
+  while (i) {
+    size_t parent = (i - 1) / 2;
+    if (!_cprogress_display_isbefore(heap[parent], heap[i])) return;
 
-  /* move to head for redraw */
-  if (cprogress->last_alive_task_count) {
-    cprogress_console_moverel(0, (short) -cprogress->last_alive_task_count);
-    cprogress_console_resetline();
+    cprogress_displayentry_t entry = heap[i];
+    heap[i] = heap[parent];
+    heap[parent] = entry;
+    i = parent;
   }
 }
 
-void cprogress_rendersum(cprogress_t *cprogress, const char *title) {
-  if (!cprogress) return;
+/* catch up with what changed since the last frame */
+void _cprogress_display_observe(cprogress_taskinfo_t *taskinfo, int64_t now) {
+  float percentage = cprogress_taskinfo_getpercentage(taskinfo);
+
+  if (!taskinfo->display_change_ns || percentage < taskinfo->display_percentage) {
+    /* new, or restarted */
+    taskinfo->display_percentage = percentage;
+    taskinfo->display_rate = 0;
+    taskinfo->display_change_ns = now;
+    return;
+  }
+  if (percentage == taskinfo->display_percentage) return;
+
+  int64_t elapsed_ns = now - taskinfo->display_change_ns;
+  float rate = elapsed_ns > 0? (percentage - taskinfo->display_percentage) * 1e9f / elapsed_ns: 0;
+  taskinfo->display_rate = taskinfo->display_rate?
+    taskinfo->display_rate + CPROGRESS_DISPLAY_RATESMOOTHING * (rate - taskinfo->display_rate):
+    rate;
+  taskinfo->display_percentage = percentage;
+  taskinfo->display_change_ns = now;
+}
+
+/* marks at most [row_count] running tasks, returns how many */
+int _cprogress_display_select(cprogress_t *cprogress, int row_count) {
+  int64_t now = cprogress_nanotime();
+  cprogress_displayentry_t *heap = cprogress->display_heap;
+  size_t heap_length = 0;
 
-  int alive_task_count = 0;
-  float percentage = 0;
   cprogress_taskinfo_foreach(cprogress, taskinfo) {
-    if (taskinfo->is_running) {
-      percentage += taskinfo->percentage;
-      ++alive_task_count;
+    if (!cprogress_taskinfo_isrunning(taskinfo)) {
+      taskinfo->display_change_ns = 0;
+      continue;
+    }
+    _cprogress_display_observe(taskinfo, now);
+
+    cprogress_displayentry_t entry = { _cprogress_display_key(cprogress, taskinfo, now), taskinfo };
+    if (heap_length < (size_t) row_count) {
+      heap[heap_length] = entry;
+      _cprogress_display_siftup(heap, heap_length++);
+    } else if (_cprogress_display_isbefore(entry, heap[0])) {
+      heap[0] = entry;
+      _cprogress_display_siftdown(heap, heap_length);
     }
   }
-  percentage /= alive_task_count;
 
-  cprogress_renderline(cprogress, title, percentage);
+  /* never zero, that's what a fresh task has */
+  if (!++cprogress->display_mark) ++cprogress->display_mark;
+  for (size_t i = 0; i < heap_length; ++i)
+    heap[i].taskinfo->display_mark = cprogress->display_mark;
+  return (int) heap_length;
 }
 
-void cprogress_render_tillcomplete(cprogress_t *cprogress, int fps) {
-  if (!cprogress) return;
+#define _cprogress_display_ischosen(cp, taskinfo) \
+  ((cp)->display_policy == CPROGRESS_DISPLAY_INDEX || (taskinfo)->display_mark == (cp)->display_mark)
 
-  while (cprogress_stillrunning(cprogress)) {
-    cprogress_beginrender(cprogress);
-    cprogress_render(cprogress);
-    cprogress_endrender(cprogress);
-    cprogress_waitfps(cprogress, fps);
-  }
+/* how many to draw out of [alive_task_count] */
+int _cprogress_display_begin(cprogress_t *cprogress, int alive_task_count, int row_count) {
+  if (cprogress->display_row_count && cprogress->display_row_count < row_count)
+    row_count = cprogress->display_row_count;
+  if (cprogress->display_policy == CPROGRESS_DISPLAY_INDEX)
+    return alive_task_count < row_count? alive_task_count: row_count;
+  return _cprogress_display_select(cprogress, row_count);
 }
 
+int cprogress_setdisplay(cprogress_t *cprogress, cprogress_displaypolicy_t policy, int row_count) {
+  if (!cprogress || policy < CPROGRESS_DISPLAY_INDEX || policy >= CPROGRESS_DISPLAY_LENGTH || row_count < 0)
+    return CPROGRESS_ERROR_INVAL;
+  if (cprogress->is_rendering) return CPROGRESS_ERROR_INVAL;
 
-void cprogress_waitms(cprogress_t *cprogress, long ms) {
-  if (!cprogress) return;
+  /* all of them can't be chosen from a heap */
+  if (!row_count) policy = CPROGRESS_DISPLAY_INDEX;
 
-  cprogress_msleep(ms);
+  cprogress_displayentry_t *display_heap = NULL;
+  if (policy != CPROGRESS_DISPLAY_INDEX) {
+    display_heap = (cprogress_displayentry_t *) CPROGRESS_MALLOC(row_count * sizeof(cprogress_displayentry_t));
+    if (!display_heap) return CPROGRESS_ERROR_INTERNAL;
+  }
+
+  _cprogress_destroy_tryfree(cprogress->display_heap);
+  cprogress->display_heap = display_heap;
+  cprogress->display_policy = policy;
+  cprogress->display_row_count = row_count;
+  _cprogress_markdirty(cprogress);
+  return CPROGRESS_ERROR_OK;
 }
 
-void cprogress_waitfps(cprogress_t *cprogress, int fps) {
-  if (!cprogress) return;
+/* whether cprogress_render(...) has anything new to draw, takes the dirty
+  mark so updates from now on count for the next frame */
+int _cprogress_render_isdirty(cprogress_t *cprogress) {
+  int is_dirty = __atomic_exchange_n(&cprogress->is_dirty, 0, __ATOMIC_ACQUIRE);
+  if (cprogress->has_custom_element) is_dirty = 1;
+
+  /* stalls, fading rates */
+  if (cprogress->has_statestyle || cprogress->display_policy != CPROGRESS_DISPLAY_INDEX) {
+    int64_t now = cprogress_nanotime();
+    if (now - cprogress->repaint_ns >= CPROGRESS_RENDER_REPAINT_MS * 1000000LL) is_dirty = 1;
+    if (is_dirty) cprogress->repaint_ns = now;
+  }
 
-  cprogress_waitms(cprogress, 1000L / fps);
+  return is_dirty;
 }
 
+/* running tasks as one line, see SLOW TERMINALS */
+void _cprogress_fillsummary(cprogress_t *cprogress) {
+  int alive_task_count = 0;
+  float percentage = 0;
+  cprogress_taskinfo_foreach(cprogress, taskinfo) {
+    if (cprogress_taskinfo_isrunning(taskinfo)) {
+      percentage += cprogress_taskinfo_getpercentage(taskinfo);
+      ++alive_task_count;
+    }
+  }
+  if (alive_task_count) percentage /= alive_task_count;
 
-/*----------------------------------------------------------------------------
-| data provider
-----------------------------------------------------------------------------*/
+  char title[32];
+  snprintf(title, sizeof(title), "%d tasks", alive_task_count);
+  _cprogress_fillline(cprogress, title, percentage);
+}
 
-void cprogress_taskinfo_updatetitle(cprogress_taskinfo_t *taskinfo, const char *title) {
-  if (!taskinfo) return;
+/* cprogress_render(...) for pinned rows: the cursor stays in the scrolling
+  region, bars are drawn aside */
+void _cprogress_renderpinned(cprogress_t *cprogress) {
+  cprogress->has_rendered_tasks = 1;
 
+  /* finished ones go to the scrollback like they do unpinned */
+  cprogress_taskinfo_foreach(cprogress, taskinfo) {
+    if (cprogress_taskinfo_getstate(taskinfo) == CPROGRESS_TASK_FINISHING) {
+      _cprogress_filltask(cprogress, taskinfo);
+      _cprogress_flushline(cprogress);
+      _cprogress_frame_writestr(cprogress, "\n");
+      _cprogress_finalizetask(taskinfo);
+    }
+  }
 
-}
+  _cprogress_frame_writestr(cprogress, "\x1b" "7"); /* save cursor */
 
-void cprogress_updatetask_title(cprogress_t *cprogress, int task_index, const char *title) {
-  if (!cprogress || task_index < 0 || task_index >= cprogress->taskinfos_length) return;
-  cprogress_taskinfo_t *taskinfo = &cprogress_gettaskinfo(cprogress, task_index);
-  if (!taskinfo || !taskinfo->is_running) return;
+  int first_row = cprogress->pinned_console_height - cprogress->pinned_row_count + 1;
+  int rendered_row_count = 0;
+  if (cprogress->detail_level >= CPROGRESS_DETAIL_COLLAPSED) {
+    _cprogress_frame_printf(cprogress, "\x1b[%dH\x1b[2K", first_row + rendered_row_count++);
+    _cprogress_fillsummary(cprogress);
+    _cprogress_flushline(cprogress);
+  }
 
-  char *previous_title = taskinfo->title;
-  if (previous_title) free(previous_title);
+  int chosen_row_count = rendered_row_count? 0:
+    _cprogress_display_begin(cprogress, cprogress->pinned_row_count, cprogress->pinned_row_count);
+  cprogress_taskinfo_foreach(cprogress, taskinfo) {
+    if (rendered_row_count >= chosen_row_count) break;
+    if (cprogress_taskinfo_isrunning(taskinfo) && _cprogress_display_ischosen(cprogress, taskinfo)) {
+      _cprogress_frame_printf(cprogress, "\x1b[%dH\x1b[2K", first_row + rendered_row_count);
+      _cprogress_filltask(cprogress, taskinfo);
+      _cprogress_flushline(cprogress);
+      ++rendered_row_count;
+    }
+  }
+  for (; rendered_row_count < cprogress->pinned_row_count; ++rendered_row_count)
+    _cprogress_frame_printf(cprogress, "\x1b[%dH\x1b[2K", first_row + rendered_row_count);
 
-  taskinfo->title = cprogress_strdup(title);
+  _cprogress_frame_writestr(cprogress, "\x1b" "8"); /* restore cursor */
+}
+
+void cprogress_render(cprogress_t *cprogress) {
+  if (!cprogress) return;
+
+  cprogress_stats_begintimer(render_begin);
+
+  _cprogress_history_sample(cprogress);
+
+  /* nothing to see, the last frame still stands, and tasks stopped
+    meanwhile are left to the next one */
+  if (!_cprogress_render_isdirty(cprogress)) {
+    cprogress->has_rendered_tasks = 1;
+    cprogress_stats_endtimer(cprogress->stats.render_ns, render_begin);
+    return;
+  }
+
+  if (cprogress->pinned_row_count) {
+    _cprogress_renderpinned(cprogress);
+    cprogress_stats_endtimer(cprogress->stats.render_ns, render_begin);
+    return;
+  }
+
+  cprogress->has_rendered_tasks = 1;
+
+  /* count how many tasks are alive */
+  int alive_task_count = 0;
+  cprogress_taskinfo_foreach(cprogress, taskinfo) {
+    if (cprogress_taskinfo_isrunning(taskinfo))
+      ++alive_task_count;
+  }
+  int is_collapsed = cprogress->detail_level >= CPROGRESS_DETAIL_COLLAPSED;
+  if (is_collapsed)
+    alive_task_count = alive_task_count? 1: 0;
+  else if (cprogress->display_row_count)
+    alive_task_count = _cprogress_display_begin(cprogress, alive_task_count, alive_task_count);
+
+  /* their last line, stays above the others */
+  int finished_task_count = 0;
+  cprogress_taskinfo_foreach(cprogress, taskinfo) {
+    if (cprogress_taskinfo_getstate(taskinfo) == CPROGRESS_TASK_FINISHING) {
+      _cprogress_rendertask(cprogress, taskinfo);
+      _cprogress_frame_writestr(cprogress, "\n"); /* move to next line */
+      _cprogress_finalizetask(taskinfo);
+      ++finished_task_count;
+    }
+  }
+
+  /* a task started meanwhile may not have been counted, leave it to the
+    next frame rather than running past the lines we move back over */
+  int rendered_task_count = 0;
+  if (is_collapsed && alive_task_count) {
+    _cprogress_fillsummary(cprogress);
+    _cprogress_frame_resetline(cprogress);
+    _cprogress_flushline(cprogress);
+    _cprogress_frame_writestr(cprogress, "\n");
+    ++rendered_task_count;
+  }
+  cprogress_taskinfo_foreach(cprogress, taskinfo) {
+    if (rendered_task_count >= alive_task_count) break;
+    if (cprogress_taskinfo_isrunning(taskinfo) && _cprogress_display_ischosen(cprogress, taskinfo)) {
+      _cprogress_rendertask(cprogress, taskinfo);
+      _cprogress_frame_writestr(cprogress, "\n"); /* move to next line */
+      ++rendered_task_count;
+    }
+  }
+  alive_task_count = rendered_task_count;
+
+  /* fewer lines than the last frame, e.g. collapsed or fewer rows to
+    display, the rest of it is still below */
+  if (finished_task_count + rendered_task_count < cprogress->last_alive_task_count)
+    _cprogress_frame_writestr(cprogress, "\x1b[J");
+
+  cprogress->last_alive_task_count = alive_task_count;
+
+  /* move to head for redraw */
+  if (cprogress->last_alive_task_count) {
+    _cprogress_frame_moverel(cprogress, 0, (short) -cprogress->last_alive_task_count);
+    _cprogress_frame_writestr(cprogress, "\r");
+  }
+
+  cprogress_stats_endtimer(cprogress->stats.render_ns, render_begin);
+}
+
+void cprogress_rendersum(cprogress_t *cprogress, const char *title) {
+  if (!cprogress) return;
+
+  int alive_task_count = 0;
+  float percentage = 0;
+  cprogress_taskinfo_foreach(cprogress, taskinfo) {
+    if (cprogress_taskinfo_isrunning(taskinfo)) {
+      percentage += cprogress_taskinfo_getpercentage(taskinfo);
+      ++alive_task_count;
+    }
+  }
+  percentage /= alive_task_count;
+
+  cprogress_renderline(cprogress, title, percentage);
+}
+
+void cprogress_render_tillcomplete(cprogress_t *cprogress, int fps) {
+  if (!cprogress) return;
+
+  while (cprogress_stillrunning(cprogress)) {
+    cprogress_beginrender(cprogress);
+    cprogress_render(cprogress);
+    cprogress_endrender(cprogress);
+    cprogress_waitfps(cprogress, fps);
+  }
+}
+
+
+int cprogress_pin(cprogress_t *cprogress, int row_count) {
+  if (!cprogress || row_count <= 0) return CPROGRESS_ERROR_INVAL;
+  if (cprogress->pinned_row_count) cprogress_unpin(cprogress);
+
+  int console_height = cprogress_console_getheight();
+  if (console_height == CPROGRESS_UNDEF) return CPROGRESS_ERROR_UNSUPPORTED;
+  if (console_height <= row_count) return CPROGRESS_ERROR_INVAL;
+
+  /* bars drawn unpinned so far are left where they are */
+  for (int i = 0; i < cprogress->last_alive_task_count; ++i)
+    _cprogress_frame_writestr(cprogress, "\n");
+  cprogress->last_alive_task_count = 0;
+
+  /* make room at the bottom, then fence it off, setting margins moves the
+    cursor home so keep it */
+  for (int i = 0; i < row_count; ++i)
+    _cprogress_frame_writestr(cprogress, "\n");
+  _cprogress_frame_printf(cprogress, "\x1b[%dA" "\x1b" "7" "\x1b[1;%dr" "\x1b" "8",
+    row_count, console_height - row_count);
+
+  cprogress->pinned_row_count = row_count;
+  cprogress->console_height = console_height;
+  _cprogress_markdirty(cprogress);
+  cprogress->pinned_console_height = console_height;
+  cprogress_console_guardmargins(1);
+
+  if (!cprogress->is_rendering) _cprogress_frame_flush(cprogress);
+  return CPROGRESS_ERROR_OK;
+}
+
+void cprogress_unpin(cprogress_t *cprogress) {
+  if (!cprogress || !cprogress->pinned_row_count) return;
+
+  /* clear the rows, then give them back */
+  _cprogress_frame_writestr(cprogress, "\x1b" "7");
+  int first_row = cprogress->pinned_console_height - cprogress->pinned_row_count + 1;
+  for (int i = 0; i < cprogress->pinned_row_count; ++i)
+    _cprogress_frame_printf(cprogress, "\x1b[%dH\x1b[2K", first_row + i);
+  _cprogress_frame_writestr(cprogress, "\x1b[r" "\x1b" "8");
+
+  cprogress->pinned_row_count = 0;
+  _cprogress_markdirty(cprogress);
+  if (!cprogress->is_rendering) _cprogress_frame_flush(cprogress);
+  cprogress_console_guardmargins(0);
+}
+
+
+void cprogress_waitms(cprogress_t *cprogress, long ms) {
+  if (!cprogress) return;
+
+  /* spend the time serving reporters instead of sleeping */
+  if (cprogress->ingest) {
+    int64_t deadline = cprogress_nanotime() + ms * 1000000LL;
+    for (long remaining_ms = ms; remaining_ms > 0;
+      remaining_ms = (long) ((deadline - cprogress_nanotime()) / 1000000LL)) {
+      if (cprogress_ingest_poll(cprogress, remaining_ms) < 0) {
+        cprogress_msleep(remaining_ms);
+        break;
+      }
+    }
+    return;
+  }
+
+  cprogress_msleep(ms);
+}
+
+void cprogress_waitfps(cprogress_t *cprogress, int fps) {
+  if (!cprogress) return;
+
+  cprogress_waitms(cprogress, 1000L / fps * cprogress->fps_divisor);
+}
+
+
+void _cprogress_tick_arm(cprogress_tick_t *tick, int64_t deadline);
+void _cprogress_tick_drain(cprogress_tick_t *tick);
+
+/* when the next frame is due, right after the last one unless something
+  changed: then only what time alone changes is drawn */
+int64_t _cprogress_tick_deadline(cprogress_t *cprogress, int fps) {
+  int64_t frame_ns = 1000000000LL / fps * cprogress->fps_divisor;
+  if (cprogress_relaxed_load(&cprogress->is_dirty) || cprogress->has_custom_element)
+    return cprogress->tick_ns + frame_ns;
+
+  int64_t idle_ns = CPROGRESS_RENDER_REPAINT_MS * 1000000LL;
+  if (cprogress->has_sparkline_element && cprogress->history_interval_ns < idle_ns)
+    idle_ns = cprogress->history_interval_ns;
+  return cprogress->tick_ns + (idle_ns > frame_ns? idle_ns: frame_ns);
+}
+
+int64_t cprogress_tick(cprogress_t *cprogress, int fps) {
+  if (!cprogress || fps <= 0) return CPROGRESS_UNDEF;
+
+  if (cprogress->tick) _cprogress_tick_drain(cprogress->tick);
+
+  int64_t now = cprogress_nanotime();
+  if (now >= _cprogress_tick_deadline(cprogress, fps)) {
+    cprogress->tick_ns = now;
+    cprogress_beginrender(cprogress);
+    cprogress_render(cprogress);
+    cprogress_endrender(cprogress);
+  }
+
+  int64_t deadline = _cprogress_tick_deadline(cprogress, fps);
+  if (cprogress->tick) _cprogress_tick_arm(cprogress->tick, deadline);
+  return deadline;
+}
+
+
+/*----------------------------------------------------------------------------
+| data provider
+----------------------------------------------------------------------------*/
+
+void cprogress_taskinfo_updatetitle(cprogress_taskinfo_t *taskinfo, const char *title) {
+  cprogress_taskinfo_updatetitlen(taskinfo, title, title? strlen(title): 0);
+}
+
+void cprogress_taskinfo_updatetitlen(cprogress_taskinfo_t *taskinfo, const char *title, size_t title_length) {
+  if (!taskinfo) return;
+
+  /* allocate and free outside the lock, the renderer may be waiting */
+  char *new_title = cprogress_strndup(title, title_length);
+
+  cprogress_taskinfo_locktitle(taskinfo);
+  char *previous_title = taskinfo->title;
+  taskinfo->title = new_title;
+  cprogress_taskinfo_unlocktitle(taskinfo);
+
+  if (previous_title) CPROGRESS_FREE(previous_title);
+}
+
+void _cprogress_updatetitle(cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo, const char *title, size_t title_length) {
+  if (!cprogress_taskinfo_isrunning(taskinfo)) return;
+
+  cprogress_stats_add(taskinfo->stats.title_update_count, 1);
+  cprogress_taskinfo_updatetitlen(taskinfo, title, title_length);
+  _cprogress_markdirty(cprogress);
+}
+
+void _cprogress_updatepercentage(cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo, float percentage) {
+  if (!cprogress_taskinfo_isrunning(taskinfo)) return;
+
+  cprogress_stats_add(taskinfo->stats.update_count, 1);
+  if (percentage < 0) percentage = 0;
+  if (percentage >= 100) {
+    cprogress_taskinfo_setpercentage(taskinfo, 100);
+    _cprogress_stoptask(cprogress, taskinfo, 0);
+    return;
+  }
+  cprogress_taskinfo_setpercentage(taskinfo, percentage);
+  _cprogress_touchtask(cprogress, taskinfo, percentage);
+}
+
+void _cprogress_addpercentage(cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo, float delta) {
+  if (!cprogress_taskinfo_isrunning(taskinfo)) return;
+
+  cprogress_stats_add(taskinfo->stats.update_count, 1);
+
+  /* concurrent deltas must all count */
+  float percentage = cprogress_taskinfo_getpercentage(taskinfo);
+  float new_percentage;
+  do {
+    new_percentage = percentage + delta;
+    if (new_percentage < 0) new_percentage = 0;
+    if (new_percentage > 100) new_percentage = 100;
+  } while (!__atomic_compare_exchange(&taskinfo->percentage, &percentage, &new_percentage,
+    1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  if (new_percentage >= 100) _cprogress_stoptask(cprogress, taskinfo, 0);
+  else _cprogress_touchtask(cprogress, taskinfo, new_percentage);
+}
+
+void cprogress_updatetask_title(cprogress_t *cprogress, int task_index, const char *title) {
+  if (!cprogress || task_index < 0 || task_index >= cprogress->taskinfos_length) return;
+  _cprogress_updatetitle(cprogress, &cprogress_gettaskinfo(cprogress, task_index), title, title? strlen(title): 0);
+}
+
+void cprogress_updatetask_titlen(cprogress_t *cprogress, int task_index, const char *title, size_t title_length) {
+  if (!cprogress || task_index < 0 || task_index >= cprogress->taskinfos_length) return;
+  _cprogress_updatetitle(cprogress, &cprogress_gettaskinfo(cprogress, task_index), title, title_length);
 }
 
 void cprogress_updatetask_percentage(cprogress_t *cprogress, int task_index, float percentage) {
   if (!cprogress || task_index < 0 || task_index >= cprogress->taskinfos_length) return;
-  cprogress_taskinfo_t *taskinfo = &cprogress_gettaskinfo(cprogress, task_index);
-  if (!taskinfo || !taskinfo->is_running) return;
+  _cprogress_updatepercentage(cprogress, &cprogress_gettaskinfo(cprogress, task_index), percentage);
+}
 
-  if (percentage >= 100) {
-    percentage = 100;
-    cprogress_aborttask(cprogress, task_index);
+void cprogress_updatetask_addpercentage(cprogress_t *cprogress, int task_index, float delta) {
+  if (!cprogress || task_index < 0 || task_index >= cprogress->taskinfos_length) return;
+  _cprogress_addpercentage(cprogress, &cprogress_gettaskinfo(cprogress, task_index), delta);
+}
+
+/* by handle, stale ones are ignored */
+
+void cprogress_task_updatetitle(cprogress_taskhandle_t task, const char *title) {
+  cprogress_taskinfo_t *taskinfo = _cprogress_task_resolve(task);
+  if (taskinfo) _cprogress_updatetitle(task.cprogress, taskinfo, title, title? strlen(title): 0);
+}
+
+void cprogress_task_updatetitlen(cprogress_taskhandle_t task, const char *title, size_t title_length) {
+  cprogress_taskinfo_t *taskinfo = _cprogress_task_resolve(task);
+  if (taskinfo) _cprogress_updatetitle(task.cprogress, taskinfo, title, title_length);
+}
+
+void cprogress_task_updatepercentage(cprogress_taskhandle_t task, float percentage) {
+  cprogress_taskinfo_t *taskinfo = _cprogress_task_resolve(task);
+  if (taskinfo) _cprogress_updatepercentage(task.cprogress, taskinfo, percentage);
+}
+
+void cprogress_task_addpercentage(cprogress_taskhandle_t task, float delta) {
+  cprogress_taskinfo_t *taskinfo = _cprogress_task_resolve(task);
+  if (taskinfo) _cprogress_addpercentage(task.cprogress, taskinfo, delta);
+}
+
+
+/*----------------------------------------------------------------------------
+| parallel for
+----------------------------------------------------------------------------*/
+
+/* a Chase-Lev deque of chunks per worker, nothing is pushed once running
+  so the buffer is implicit: slot [i] holds chunk [first_chunk + i] */
+typedef struct {
+  long top; /* thieves take from here */
+  char top_pad[64 - sizeof(long)];
+  long bottom; /* the owner, from here */
+  long done_count; /* items, only the owner writes it */
+  char bottom_pad[64 - 2 * sizeof(long)];
+
+  struct _cprogress_parallel *parallel;
+  int index;
+  long first_chunk;
+  uint64_t seed; /* picks victims */
+  cprogress_thread_t thread;
+  int has_thread;
+  cprogress_taskhandle_t row; /* only with CPROGRESS_PARALLEL_WORKERROWS */
+} _cprogress_parallelworker_t;
+
+typedef struct _cprogress_parallel {
+  cprogress_t *cprogress;
+  cprogress_parallel_func_t *func;
+  void *ctx;
+  long begin;
+  long end;
+  long grain;
+  int worker_count;
+  _cprogress_parallelworker_t *workers;
+  cprogress_taskhandle_t task;
+  int64_t report_ns; /* next time a worker reports */
+} _cprogress_parallel_t;
+
+#define _cprogress_parallel_reporting INT64_MAX /* [report_ns] while a worker is at it */
+#define _cprogress_parallel_failed (-1) /* empty */
+#define _cprogress_parallel_contended (-2) /* lost a race, may not be empty */
+
+/* owner only, every access is seq_cst, as the algorithm assumes */
+long _cprogress_parallel_take(_cprogress_parallelworker_t *worker) {
+  long bottom = cprogress_relaxed_load(&worker->bottom) - 1;
+  __atomic_store_n(&worker->bottom, bottom, __ATOMIC_SEQ_CST);
+  long top = __atomic_load_n(&worker->top, __ATOMIC_SEQ_CST);
+
+  if (top > bottom) {
+    cprogress_relaxed_store(&worker->bottom, bottom + 1);
+    return _cprogress_parallel_failed;
   }
-  if (percentage < 0) percentage = 0;
-  taskinfo->percentage = percentage;
+  if (top == bottom) {
+    /* the last one, thieves may want it too */
+    int is_taken = __atomic_compare_exchange_n(&worker->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    cprogress_relaxed_store(&worker->bottom, bottom + 1);
+    return is_taken? worker->first_chunk + bottom: _cprogress_parallel_failed;
+  }
+  return worker->first_chunk + bottom;
 }
 
+long _cprogress_parallel_steal(_cprogress_parallelworker_t *victim) {
+  long top = __atomic_load_n(&victim->top, __ATOMIC_SEQ_CST);
+  long bottom = __atomic_load_n(&victim->bottom, __ATOMIC_SEQ_CST);
+  if (top >= bottom) return _cprogress_parallel_failed;
 
-void cprogress_subscribeevent(cprogress_t *cprogress, cprogress_event_type_t type, cprogress_eventsubscriber_func_t *func) {
-  if (!cprogress) return;
+  if (!__atomic_compare_exchange_n(&victim->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    return _cprogress_parallel_contended;
+  return victim->first_chunk + top;
+}
+
+/* from anyone but [worker], starting somewhere random so thieves spread,
+  empty ones stay empty so a round without races means all is taken */
+long _cprogress_parallel_stealany(_cprogress_parallelworker_t *worker) {
+  _cprogress_parallel_t *parallel = worker->parallel;
+  while (1) {
+    int is_contended = 0;
+
+    worker->seed ^= worker->seed << 13;
+    worker->seed ^= worker->seed >> 7;
+    worker->seed ^= worker->seed << 17;
+    int first = (int) (worker->seed % (uint64_t) parallel->worker_count);
+
+    for (int i = 0; i < parallel->worker_count; ++i) {
+      _cprogress_parallelworker_t *victim = &parallel->workers[(first + i) % parallel->worker_count];
+      if (victim == worker) continue;
+
+      long chunk = _cprogress_parallel_steal(victim);
+      if (chunk >= 0) return chunk;
+      if (chunk == _cprogress_parallel_contended) is_contended = 1;
+    }
+
+    if (!is_contended) return _cprogress_parallel_failed;
+    cprogress_cpu_relax();
+  }
+}
+
+/* one worker at a time, adds up the counters into the tasks */
+void _cprogress_parallel_report(_cprogress_parallel_t *parallel, int is_done) {
+  long total = parallel->end - parallel->begin;
+  long done_count = 0;
+  for (int i = 0; i < parallel->worker_count; ++i) {
+    _cprogress_parallelworker_t *worker = &parallel->workers[i];
+    long worker_done_count = cprogress_relaxed_load(&worker->done_count);
+    done_count += worker_done_count;
+
+    /* its part of an even share, it only finishes with the whole loop */
+    if (worker->row.cprogress) {
+      float percentage = (float) (100.0 * worker_done_count * parallel->worker_count / total);
+      if (!is_done && percentage > 99.99f) percentage = 99.99f;
+      cprogress_task_updatepercentage(worker->row, is_done? 100: percentage);
+    }
+  }
+
+  float percentage = (float) (100.0 * done_count / total);
+  if (!is_done && percentage > 99.99f) percentage = 99.99f;
+  cprogress_task_updatepercentage(parallel->task, is_done? 100: percentage);
+
+  if (!(parallel->cprogress->parallel_flags & CPROGRESS_PARALLEL_NORENDER)) {
+    cprogress_beginrender(parallel->cprogress);
+    cprogress_render(parallel->cprogress);
+    cprogress_endrender(parallel->cprogress);
+  }
+}
+
+/* whoever is first past the deadline, so neither a long chunk nor an idle
+  worker holds the frames back, the next one takes over the renderer */
+void _cprogress_parallel_tryreport(_cprogress_parallel_t *parallel) {
+  int64_t report_ns = cprogress_relaxed_load(&parallel->report_ns);
+  int64_t now = cprogress_nanotime();
+  if (now < report_ns) return;
+  if (!__atomic_compare_exchange_n(&parallel->report_ns, &report_ns, _cprogress_parallel_reporting, 0,
+    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return;
+
+  _cprogress_parallel_report(parallel, 0);
+  __atomic_store_n(&parallel->report_ns, now + 1000000000LL / CPROGRESS_PARALLEL_FPS, __ATOMIC_RELEASE);
+}
+
+void _cprogress_parallel_work(void *userdata) {
+  _cprogress_parallelworker_t *worker = (_cprogress_parallelworker_t *) userdata;
+  _cprogress_parallel_t *parallel = worker->parallel;
+
+  while (1) {
+    long chunk = _cprogress_parallel_take(worker);
+    if (chunk < 0) chunk = _cprogress_parallel_stealany(worker);
+    if (chunk < 0) return;
+
+    long chunk_begin = parallel->begin + chunk * parallel->grain;
+    long chunk_end = parallel->end - chunk_begin > parallel->grain? chunk_begin + parallel->grain: parallel->end;
+    parallel->func(chunk_begin, chunk_end, worker->index, parallel->ctx);
+    cprogress_relaxed_store(&worker->done_count, worker->done_count + (chunk_end - chunk_begin));
+
+    _cprogress_parallel_tryreport(parallel);
+  }
+}
+
+int cprogress_parallel_for(cprogress_t *cprogress, long begin, long end, long grain,
+  cprogress_parallel_func_t *func, void *ctx) {
+  if (!cprogress || !func || grain < 0) return CPROGRESS_ERROR_INVAL;
+  if (begin >= end) return CPROGRESS_ERROR_OK;
+
+  int worker_count = cprogress->parallel_worker_count? cprogress->parallel_worker_count: cprogress_cpu_count();
+  if (worker_count > CPROGRESS_PARALLEL_MAXWORKERS) worker_count = CPROGRESS_PARALLEL_MAXWORKERS;
+  if (!grain) grain = (end - begin) / ((long) worker_count * CPROGRESS_PARALLEL_CHUNKSPERWORKER);
+  if (grain < 1) grain = 1;
+  long chunk_count = (end - begin - 1) / grain + 1;
+  if (worker_count > chunk_count) worker_count = (int) chunk_count;
+
+  /* keep the deques' ends apart, malloc only goes as far as 16 bytes */
+  void *workers_buf = CPROGRESS_MALLOC(worker_count * sizeof(_cprogress_parallelworker_t) + 64);
+  if (!workers_buf) return CPROGRESS_ERROR_INTERNAL;
+  memset(workers_buf, 0, worker_count * sizeof(_cprogress_parallelworker_t) + 64);
+
+  _cprogress_parallel_t parallel = {
+    .cprogress = cprogress,
+    .func = func,
+    .ctx = ctx,
+    .begin = begin,
+    .end = end,
+    .grain = grain,
+    .worker_count = worker_count,
+    .workers = (_cprogress_parallelworker_t *) (((uintptr_t) workers_buf + 63) & ~(uintptr_t) 63),
+    .task = cprogress_task_acquire(cprogress),
+  };
+
+  char title[64];
+  snprintf(title, sizeof(title), "%ld items, %d workers", end - begin, worker_count);
+  cprogress_task_start(parallel.task);
+  cprogress_task_updatetitle(parallel.task, title);
+
+  for (int i = 0; i < worker_count; ++i) {
+    _cprogress_parallelworker_t *worker = &parallel.workers[i];
+    worker->parallel = &parallel;
+    worker->index = i;
+    worker->first_chunk = chunk_count * i / worker_count;
+    worker->bottom = chunk_count * (i + 1) / worker_count - worker->first_chunk;
+    worker->seed = 0x9e3779b97f4a7c15ULL * (i + 1);
+
+    if (cprogress->parallel_flags & CPROGRESS_PARALLEL_WORKERROWS) {
+      worker->row = cprogress_task_acquire(cprogress);
+      snprintf(title, sizeof(title), "worker %d", i);
+      cprogress_task_start(worker->row);
+      cprogress_task_updatetitle(worker->row, title);
+    }
+  }
+
+  /* those that can't be started have their chunks stolen */
+  for (int i = 1; i < worker_count; ++i) {
+    _cprogress_parallelworker_t *worker = &parallel.workers[i];
+    worker->has_thread = !cprogress_thread_create(&worker->thread, _cprogress_parallel_work, worker);
+  }
+  _cprogress_parallel_work(&parallel.workers[0]);
+  for (int i = 1; i < worker_count; ++i) {
+    if (parallel.workers[i].has_thread) cprogress_thread_join(parallel.workers[i].thread);
+  }
+
+  /* the last frame shows them done */
+  _cprogress_parallel_report(&parallel, 1);
+  for (int i = 0; i < worker_count; ++i)
+    cprogress_task_release(parallel.workers[i].row);
+  cprogress_task_release(parallel.task);
+
+  CPROGRESS_FREE(workers_buf);
+  return CPROGRESS_ERROR_OK;
+}
+
+int cprogress_setparallel(cprogress_t *cprogress, int worker_count, int flags) {
+  if (!cprogress || worker_count < 0) return CPROGRESS_ERROR_INVAL;
+
+  cprogress->parallel_worker_count = worker_count;
+  cprogress->parallel_flags = flags;
+  return CPROGRESS_ERROR_OK;
+}
+
+
+/*----------------------------------------------------------------------------
+| stats
+----------------------------------------------------------------------------*/
+
+int cprogress_getstats(cprogress_t *cprogress, cprogress_stats_t *stats) {
+  if (!cprogress || !stats) return CPROGRESS_ERROR_INVAL;
+  memset(stats, 0, sizeof(cprogress_stats_t));
+
+#ifdef CPROGRESS_CONFIG_STATS
+  /* updaters count per task, so they never share a counter */
+  cprogress_taskinfo_foreach(cprogress, taskinfo) {
+    stats->update_count += cprogress_relaxed_load(&taskinfo->stats.update_count);
+    stats->title_update_count += cprogress_relaxed_load(&taskinfo->stats.title_update_count);
+  }
+
+  stats->frame_count = cprogress_relaxed_load(&cprogress->stats.frame_count);
+  stats->skipped_frame_count = cprogress_relaxed_load(&cprogress->stats.skipped_frame_count);
+  stats->emitted_bytes = cprogress_relaxed_load(&cprogress->stats.emitted_bytes);
+  stats->write_count = cprogress_relaxed_load(&cprogress->stats.write_count);
+  stats->consolewidth_query_count = cprogress_relaxed_load(&cprogress->stats.consolewidth_query_count);
+  stats->render_ns = cprogress_relaxed_load(&cprogress->stats.render_ns);
+  stats->writeline_count = cprogress_relaxed_load(&cprogress->stats.writeline_count);
+  stats->writeline_ns = cprogress_relaxed_load(&cprogress->stats.writeline_ns);
+  return CPROGRESS_ERROR_OK;
+#else
+  return CPROGRESS_ERROR_UNSUPPORTED;
+#endif
+}
+
+int cprogress_gettaskstats(cprogress_t *cprogress, int task_index, cprogress_taskstats_t *stats) {
+  cprogress_taskinfo_t *taskinfo = cprogress_findtaskinfo(cprogress, task_index);
+  if (!taskinfo || !stats) return CPROGRESS_ERROR_INVAL;
+  memset(stats, 0, sizeof(cprogress_taskstats_t));
+
+#ifdef CPROGRESS_CONFIG_STATS
+  stats->update_count = cprogress_relaxed_load(&taskinfo->stats.update_count);
+  stats->title_update_count = cprogress_relaxed_load(&taskinfo->stats.title_update_count);
+  return CPROGRESS_ERROR_OK;
+#else
+  return CPROGRESS_ERROR_UNSUPPORTED;
+#endif
+}
+
+
+/*----------------------------------------------------------------------------
+| history
+----------------------------------------------------------------------------*/
+
+void _cprogress_history_sample(cprogress_t *cprogress) {
+  if (!cprogress->history_length) return;
+
+  int64_t now = cprogress_nanotime();
+  if (now - cprogress->history_sample_ns < cprogress->history_interval_ns) return;
+  cprogress->history_sample_ns = now;
+
+  cprogress_taskinfo_foreach(cprogress, taskinfo) {
+    if (!cprogress_taskinfo_isrunning(taskinfo)) continue;
+
+    if (!taskinfo->history) {
+      taskinfo->history = (uint16_t *) CPROGRESS_MALLOC(cprogress->history_length * sizeof(uint16_t));
+      if (!taskinfo->history) continue;
+      taskinfo->history_count = 0;
+      taskinfo->history_percentage = 0;
+    }
+
+    float percentage = cprogress_taskinfo_getpercentage(taskinfo);
+    if (percentage < taskinfo->history_percentage) {
+      /* restarted */
+      taskinfo->history_count = 0;
+      taskinfo->history_percentage = 0;
+    }
+
+    float delta = (percentage - taskinfo->history_percentage) * 100 + 0.5f;
+    taskinfo->history[taskinfo->history_count++ % cprogress->history_length] =
+      (uint16_t) (delta < 10000? delta: 10000);
+    taskinfo->history_percentage = percentage;
+    /* the sparkline moved along */
+    if (cprogress->has_sparkline_element) _cprogress_markdirty(cprogress);
+  }
+}
+
+int cprogress_sethistory(cprogress_t *cprogress, size_t length, long interval_ms) {
+  if (!cprogress || length > CPROGRESS_HISTORY_MAXLENGTH || interval_ms < 0) return CPROGRESS_ERROR_INVAL;
+  if (cprogress->is_rendering) return CPROGRESS_ERROR_INVAL;
+
+  /* rings are sized once, start over */
+  if (length != cprogress->history_length) {
+    cprogress_taskinfo_foreach(cprogress, taskinfo) {
+      _cprogress_destroy_tryfree(taskinfo->history);
+    }
+  }
+
+  cprogress->history_length = length;
+  cprogress->history_interval_ns = (interval_ms? interval_ms: CPROGRESS_HISTORY_INTERVAL_MS) * 1000000LL;
+  return CPROGRESS_ERROR_OK;
+}
+
+int cprogress_gettaskhistory(cprogress_t *cprogress, int task_index, float *samples, size_t *samples_length) {
+  if (!samples_length || (*samples_length && !samples)) return CPROGRESS_ERROR_INVAL;
+  cprogress_taskinfo_t *taskinfo = cprogress_findtaskinfo(cprogress, task_index);
+  if (!taskinfo) return CPROGRESS_ERROR_INVAL;
+
+  /* the most recent ones that fit */
+  size_t count = 0;
+  if (taskinfo->history) {
+    count = taskinfo->history_count < cprogress->history_length? taskinfo->history_count: cprogress->history_length;
+    if (count > *samples_length) count = *samples_length;
+  }
+  size_t first = taskinfo->history_count - count;
+  for (size_t i = 0; i < count; ++i)
+    samples[i] = taskinfo->history[(first + i) % cprogress->history_length] / 100.0f;
+
+  *samples_length = count;
+  return CPROGRESS_ERROR_OK;
+}
+
+
+/*----------------------------------------------------------------------------
+| event
+----------------------------------------------------------------------------*/
+
+int cprogress_subscribeevent(cprogress_t *cprogress, cprogress_event_type_t type, cprogress_eventsubscriber_func_t *func) {
+  if (!cprogress || !func || type <= CPROGRESS_EVENT_NONE || type >= CPROGRESS_EVENT_LENGTH)
+    return CPROGRESS_ERROR_INVAL;
+
+  for (int i = 0; i < CPROGRESS_EVENT_MAXSUBSCRIBERS; ++i) {
+    if (!cprogress->subscribers[type][i]) {
+      cprogress->subscribers[type][i] = func;
+      return CPROGRESS_ERROR_OK;
+    }
+  }
+
+  return CPROGRESS_ERROR_BUFFUL;
+}
+
+void cprogress_unsubscribeevent(cprogress_t *cprogress, cprogress_event_type_t type, cprogress_eventsubscriber_func_t *func) {
+  if (!cprogress || type <= CPROGRESS_EVENT_NONE || type >= CPROGRESS_EVENT_LENGTH) return;
+
+  /* keep the order of the rest */
+  cprogress_eventsubscriber_func_t **subscribers = cprogress->subscribers[type];
+  int length = 0;
+  for (int i = 0; i < CPROGRESS_EVENT_MAXSUBSCRIBERS; ++i) {
+    if (subscribers[i] && subscribers[i] != func)
+      subscribers[length++] = subscribers[i];
+  }
+  while (length < CPROGRESS_EVENT_MAXSUBSCRIBERS)
+    subscribers[length++] = NULL;
+}
 
-  if (type != CPROGRESS_EVENT_NONE && type < CPROGRESS_EVENT_LENGTH) {
-    cprogress->subscribers[type] = func;
+void _cprogress_deliverevent(cprogress_t *cprogress, cprogress_event_type_t type, int task_index) {
+  for (int i = 0; i < CPROGRESS_EVENT_MAXSUBSCRIBERS; ++i) {
+    cprogress_eventsubscriber_func_t *func = cprogress->subscribers[type][i];
+    if (!func) break;
+    func(cprogress, task_index);
   }
 }
 
+/* queued, or delivered right away when not deferred, zero when the queue is full */
+int _cprogress_pushevent(cprogress_t *cprogress, cprogress_event_type_t type, int task_index) {
+  if (!cprogress->subscribers[type][0]) return 1;
+
+  if (cprogress->events) {
+    cprogress_eventrecord_t record = { type, task_index };
+    return cprogress_mpsc_trypush(cprogress->events, &record);
+  }
+
+  _cprogress_deliverevent(cprogress, type, task_index);
+  return 1;
+}
+
 void cprogress_emitevent(cprogress_t *cprogress, cprogress_event_type_t type, int task_index) {
   if (!cprogress) return;
 
-  if (type != CPROGRESS_EVENT_NONE && type < CPROGRESS_EVENT_LENGTH ||
-    (task_index > 0 && task_index < cprogress->taskinfos_length || task_index == CPROGRESS_UNDEF)) {
-    cprogress_eventsubscriber_func_t *func = cprogress->subscribers[type];
-    if (func) func(cprogress, task_index);
+  if (type <= CPROGRESS_EVENT_NONE || type >= CPROGRESS_EVENT_LENGTH) return;
+  if (task_index != CPROGRESS_UNDEF && (task_index < 0 ||
+    (size_t) task_index >= cprogress->taskinfos_length + cprogress_relaxed_load(&cprogress->taskslots_length)))
+    return;
+
+  /* never delivered here once deferred, the subscribers may not be ready
+    for another thread */
+  for (int spins = 0; !_cprogress_pushevent(cprogress, type, task_index); ) {
+    /* nobody else would drain it for the delivering thread, like
+      cprogress_stillrunning(...) does for CPROGRESS_EVENT_STOP */
+    uint64_t self = cprogress_thread_self();
+    if (self && self == cprogress_relaxed_load(&cprogress->events_thread)) {
+      cprogress_flushevents(cprogress);
+      continue;
+    }
+    if (cprogress->events_policy == CPROGRESS_EVENTS_DROP || !self) {
+      cprogress_relaxed_add(&cprogress->events_dropped_count, 1);
+      return;
+    }
+
+    /* wait for the renderer to drain it */
+    if (++spins < 64) cprogress_cpu_relax();
+    else cprogress_yield();
+  }
+}
+
+int cprogress_deferevents(cprogress_t *cprogress, size_t queue_length, cprogress_eventpolicy_t policy) {
+  if (!cprogress) return CPROGRESS_ERROR_INVAL;
+  if (cprogress->events) return CPROGRESS_ERROR_OK;
+
+  cprogress_mpsc_t *events = (cprogress_mpsc_t *) CPROGRESS_MALLOC(sizeof(cprogress_mpsc_t));
+  if (!events) return CPROGRESS_ERROR_INTERNAL;
+
+  int error = cprogress_mpsc_create(events, queue_length? queue_length: CPROGRESS_EVENT_QUEUELENGTH, sizeof(cprogress_eventrecord_t));
+  if (error) {
+    CPROGRESS_FREE(events);
+    return error;
+  }
+
+  cprogress->events_policy = policy;
+  cprogress->events_thread = cprogress_thread_self();
+  cprogress->events = events;
+  return CPROGRESS_ERROR_OK;
+}
+
+/* deliver what's queued, only from the render thread */
+void cprogress_flushevents(cprogress_t *cprogress) {
+  if (!cprogress || !cprogress->events) return;
+
+  uint64_t self = cprogress_thread_self();
+  if (self != cprogress_relaxed_load(&cprogress->events_thread))
+    cprogress_relaxed_store(&cprogress->events_thread, self);
+
+  cprogress_eventrecord_t record;
+  while (cprogress_mpsc_trypop(cprogress->events, &record))
+    _cprogress_deliverevent(cprogress, (cprogress_event_type_t) record.type, record.task_index);
+}
+
+
+/*----------------------------------------------------------------------------
+| shared region
+----------------------------------------------------------------------------*/
+
+#if defined(CPROGRESS_CONFIG_NOPLATFORM) || defined(_WIN32)
+
+int cprogress_share(cprogress_t *cprogress, const char *name) { return CPROGRESS_ERROR_UNSUPPORTED; }
+void cprogress_share_publish(cprogress_t *cprogress) {}
+void cprogress_share_tillcomplete(cprogress_t *cprogress, int fps) {}
+void cprogress_unshare(cprogress_t *cprogress) {}
+
+const cprogress_shared_t *cprogress_share_attach(const char *name, size_t *size) { return NULL; }
+void cprogress_share_detach(const cprogress_shared_t *shared, size_t size) {}
+int cprogress_share_read(const cprogress_shared_t *shared, cprogress_t *mirror) { return 0; }
+
+#else
+
+# include "errno.h"
+# include "fcntl.h"
+# include "signal.h"
+# include "sys/mman.h"
+# include "sys/stat.h"
+
+/* names are passed to shm_open(3), which wants exactly one leading slash */
+char *_cprogress_share_shmname(const char *name) {
+  if (!name || !*name) return NULL;
+  while (*name == '/') ++name;
+
+  size_t len = strlen(name);
+  char *shm_name = (char *) CPROGRESS_MALLOC(len + 2);
+  if (!shm_name) return NULL;
+  shm_name[0] = '/';
+  memcpy(shm_name + 1, name, len + 1);
+  return shm_name;
+}
+
+/* a region whose owner died without a chance to unshare can be taken over,
+  and so can one left by a job that died halfway through sharing */
+int _cprogress_share_isstale(const char *shm_name) {
+  int fd = shm_open(shm_name, O_RDONLY, 0);
+  if (fd < 0) return errno == ENOENT;
+
+  struct stat st;
+  if (fstat(fd, &st)) {
+    close(fd);
+    return 0;
+  }
+  int is_sized = st.st_size >= (off_t) sizeof(cprogress_shared_t);
+  void *mem = is_sized? mmap(NULL, sizeof(cprogress_shared_t), PROT_READ, MAP_SHARED, fd, 0): MAP_FAILED;
+  close(fd);
+  if (is_sized && mem == MAP_FAILED) return 0;
+
+  int32_t owner_pid = 0;
+  if (mem != MAP_FAILED) {
+    owner_pid = cprogress_atomic_load(&((const cprogress_shared_t *) mem)->owner_pid);
+    munmap(mem, sizeof(cprogress_shared_t));
+  }
+  /* the owner's pid goes in first, till then another job may be sharing
+    it, or have died doing so, only the region's age tells */
+  if (owner_pid <= 0) return time(NULL) - st.st_mtime >= CPROGRESS_SHARED_GRACE;
+  return kill(owner_pid, 0) && errno == ESRCH;
+}
+
+int cprogress_share(cprogress_t *cprogress, const char *name) {
+  if (!cprogress || cprogress->error) return CPROGRESS_ERROR_INVAL;
+  if (cprogress->shared) return CPROGRESS_ERROR_INVAL;
+  if (strlen(cprogress->fmt) >= CPROGRESS_SHARED_FMTLEN) return CPROGRESS_ERROR_BUFFUL;
+
+  char *shm_name = _cprogress_share_shmname(name);
+  if (!shm_name) return CPROGRESS_ERROR_INVAL;
+
+  size_t size = sizeof(cprogress_shared_t) + cprogress->taskinfos_length * sizeof(cprogress_sharedtask_t);
+
+  /* never truncate a region under a live job and its viewers */
+  int fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0 && errno == EEXIST) {
+    if (!_cprogress_share_isstale(shm_name)) {
+      CPROGRESS_FREE(shm_name);
+      return CPROGRESS_ERROR_INVAL;
+    }
+    /* viewers still attached to the stale one keep their own mapping */
+    shm_unlink(shm_name);
+    fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  }
+  if (fd < 0 || ftruncate(fd, size)) {
+    if (fd >= 0) {
+      close(fd);
+      shm_unlink(shm_name);
+    }
+    CPROGRESS_FREE(shm_name);
+    return CPROGRESS_ERROR_SYSTEM;
+  }
+
+  void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) {
+    shm_unlink(shm_name);
+    CPROGRESS_FREE(shm_name);
+    return CPROGRESS_ERROR_SYSTEM;
+  }
+
+  /* ftruncate(2) zero-filled the region, so every task starts as idle */
+  cprogress_shared_t *shared = (cprogress_shared_t *) mem;
+  /* first, so that dying from here on leaves a region the next job can
+    tell is stale right away */
+  cprogress_atomic_store(&shared->owner_pid, (int32_t) getpid());
+  shared->version = CPROGRESS_SHARED_VERSION;
+  shared->is_running = 1;
+  shared->task_count = (uint32_t) cprogress->taskinfos_length;
+  strcpy(shared->fmt, cprogress->fmt);
+  /* viewers check the magic last, so publish it after everything else */
+  cprogress_atomic_store(&shared->magic, CPROGRESS_SHARED_MAGIC);
+
+  cprogress->shared = shared;
+  cprogress->shared_size = size;
+  cprogress->shared_name = shm_name;
+
+  cprogress_share_publish(cprogress);
+  return CPROGRESS_ERROR_OK;
+}
+
+void cprogress_share_publish(cprogress_t *cprogress) {
+  if (!cprogress || !cprogress->shared) return;
+
+  /* only fixed tasks, the region doesn't grow */
+  cprogress_shared_t *shared = cprogress->shared;
+  for (int i = 0; i < cprogress->taskinfos_length; ++i) {
+    cprogress_taskinfo_t *taskinfo = &cprogress_gettaskinfo(cprogress, i);
+    cprogress_sharedtask_t staged = {
+      .is_running = cprogress_taskinfo_isrunning(taskinfo),
+      .percentage = cprogress_taskinfo_getpercentage(taskinfo),
+    };
+    cprogress_taskinfo_locktitle(taskinfo);
+    if (taskinfo->title)
+      strncpy(staged.title, taskinfo->title, CPROGRESS_SHARED_TITLELEN - 1);
+    cprogress_taskinfo_unlocktitle(taskinfo);
+
+    /* only the owner writes here, skip entries viewers already have */
+    cprogress_sharedtask_t *entry = &shared->tasks[cprogress_taskinfo_getindex(taskinfo)];
+    if (entry->is_running == staged.is_running &&
+      entry->percentage == staged.percentage &&
+      !strcmp(entry->title, staged.title)) continue;
+
+    /* seqlock, see cprogress_share_read(...) for the other half */
+    uint32_t sequence = entry->sequence;
+    __atomic_store_n(&entry->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    entry->is_running = staged.is_running;
+    entry->percentage = staged.percentage;
+    memcpy(entry->title, staged.title, CPROGRESS_SHARED_TITLELEN);
+    cprogress_atomic_store(&entry->sequence, sequence + 2);
+  }
+
+  cprogress_atomic_store(&shared->is_running, cprogress_relaxed_load(&cprogress->is_running));
+}
+
+/* like cprogress_render_tillcomplete(...), but leaves the terminal alone */
+void cprogress_share_tillcomplete(cprogress_t *cprogress, int fps) {
+  if (!cprogress) return;
+
+  while (cprogress_stillrunning(cprogress)) {
+    cprogress_share_publish(cprogress);
+    _cprogress_endframe(cprogress);
+    cprogress_waitfps(cprogress, fps);
+  }
+  cprogress_share_publish(cprogress);
+}
+
+void cprogress_unshare(cprogress_t *cprogress) {
+  if (!cprogress || !cprogress->shared) return;
+
+  /* let attached viewers know they can leave */
+  cprogress_share_publish(cprogress);
+  cprogress_atomic_store(&cprogress->shared->is_running, 0);
+
+  munmap(cprogress->shared, cprogress->shared_size);
+  shm_unlink(cprogress->shared_name);
+  CPROGRESS_FREE(cprogress->shared_name);
+
+  cprogress->shared = NULL;
+  cprogress->shared_size = 0;
+  cprogress->shared_name = NULL;
+}
+
+
+const cprogress_shared_t *cprogress_share_attach(const char *name, size_t *size) {
+  char *shm_name = _cprogress_share_shmname(name);
+  if (!shm_name) return NULL;
+
+  int fd = shm_open(shm_name, O_RDONLY, 0);
+  CPROGRESS_FREE(shm_name);
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size < sizeof(cprogress_shared_t)) {
+    close(fd);
+    return NULL;
+  }
+
+  void *mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) return NULL;
+
+  const cprogress_shared_t *shared = (const cprogress_shared_t *) mem;
+  if (cprogress_atomic_load(&shared->magic) != CPROGRESS_SHARED_MAGIC ||
+    shared->version != CPROGRESS_SHARED_VERSION ||
+    sizeof(cprogress_shared_t) + shared->task_count * sizeof(cprogress_sharedtask_t) > st.st_size) {
+    munmap(mem, st.st_size);
+    return NULL;
+  }
+
+  if (size) *size = st.st_size;
+  return shared;
+}
+
+void cprogress_share_detach(const cprogress_shared_t *shared, size_t size) {
+  if (shared) munmap((void *) shared, size);
+}
+
+/* copy the owner's task table into [mirror], which should be created with
+  shared->fmt and shared->task_count, returns 0 once the owner is gone */
+int cprogress_share_read(const cprogress_shared_t *shared, cprogress_t *mirror) {
+  if (!shared || !mirror) return 0;
+
+  size_t task_count = shared->task_count;
+  if (task_count > mirror->taskinfos_length) task_count = mirror->taskinfos_length;
+
+  for (size_t i = 0; i < task_count; ++i) {
+    const cprogress_sharedtask_t *entry = &shared->tasks[i];
+    cprogress_sharedtask_t snapshot;
+    uint32_t sequence;
+    do {
+      sequence = cprogress_atomic_load(&entry->sequence);
+      if (sequence & 1) continue;
+      memcpy(&snapshot, entry, sizeof(snapshot));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((sequence & 1) || sequence != __atomic_load_n(&entry->sequence, __ATOMIC_RELAXED));
+    snapshot.title[CPROGRESS_SHARED_TITLELEN - 1] = 0;
+
+    cprogress_taskinfo_t *taskinfo = &cprogress_gettaskinfo(mirror, i);
+    if (snapshot.is_running) {
+      if (!cprogress_taskinfo_isrunning(taskinfo)) cprogress_starttask(mirror, i);
+      if (!taskinfo->title || strcmp(taskinfo->title, snapshot.title))
+        cprogress_updatetask_title(mirror, i, snapshot.title);
+      cprogress_updatetask_percentage(mirror, i, snapshot.percentage);
+    } else if (cprogress_taskinfo_isrunning(taskinfo)) {
+      cprogress_updatetask_percentage(mirror, i, snapshot.percentage);
+      cprogress_aborttask(mirror, i);
+    }
+  }
+
+  if (!cprogress_atomic_load(&shared->is_running)) return 0;
+  /* the owner may have died without a chance to unshare */
+  if (kill(shared->owner_pid, 0) && errno == ESRCH) return 0;
+  return 1;
+}
+
+#endif /* CPROGRESS_CONFIG_NOPLATFORM */
+
+
+/*----------------------------------------------------------------------------
+| ingest
+----------------------------------------------------------------------------*/
+
+/* one update per line, fields separated by spaces:
+    <index> <percentage>    e.g. "3 42.5"
+    <index> +<delta>        e.g. "3 +0.25"
+    <index> -<delta>
+    <index> s               start the task
+    <index> a               abort the task
+    <index> t <title>       update the title
+  lines failing to parse or naming a task out of range are counted as
+  rejected and skipped */
+
+const char *_cprogress_ingest_parsefloat(const char *ptr, const char *end, float *value) {
+  float result = 0;
+  int has_digit = 0;
+
+  for (; ptr < end && cprogress_isnumber(*ptr); ++ptr, has_digit = 1)
+    result = result * 10 + (*ptr - '0');
+
+  if (ptr < end && *ptr == '.') {
+    float scale = 0.1f;
+    for (++ptr; ptr < end && cprogress_isnumber(*ptr); ++ptr, has_digit = 1) {
+      result += (*ptr - '0') * scale;
+      scale *= 0.1f;
+    }
+  }
+
+  if (!has_digit) return NULL;
+  *value = result;
+  return ptr;
+}
+
+int _cprogress_ingest_applyline(cprogress_t *cprogress, const char *ptr, const char *end) {
+  if (end > ptr && end[-1] == '\r') --end;
+
+  size_t task_index = 0;
+  const char *index_begin = ptr;
+  for (; ptr < end && cprogress_isnumber(*ptr); ++ptr) {
+    task_index = task_index * 10 + (*ptr - '0');
+    if (task_index >= cprogress->taskinfos_length) return 1;
+  }
+  if (ptr == index_begin) return 1;
+
+  if (ptr >= end || *ptr != ' ') return 1;
+  while (ptr < end && *ptr == ' ') ++ptr;
+  if (ptr >= end) return 1;
+
+  float value = 0;
+  switch (*ptr) {
+    case '+':
+    case '-':
+      if (_cprogress_ingest_parsefloat(ptr + 1, end, &value) != end) return 1;
+      cprogress_updatetask_addpercentage(cprogress, (int) task_index, *ptr == '-'? -value: value);
+      return 0;
+    case 's':
+      if (ptr + 1 != end) return 1;
+      cprogress_starttask(cprogress, (int) task_index);
+      return 0;
+    case 'a':
+      if (ptr + 1 != end) return 1;
+      cprogress_aborttask(cprogress, (int) task_index);
+      return 0;
+    case 't':
+      if (ptr + 1 < end && ptr[1] != ' ') return 1;
+      ptr += ptr + 1 < end? 2: 1;
+      cprogress_updatetask_titlen(cprogress, (int) task_index, ptr, end - ptr);
+      return 0;
+    default:
+      if (_cprogress_ingest_parsefloat(ptr, end, &value) != end) return 1;
+      cprogress_updatetask_percentage(cprogress, (int) task_index, value);
+      return 0;
+  }
+}
+
+/* applies every complete line in [buf], returns how many bytes were used */
+size_t cprogress_ingest_apply(cprogress_t *cprogress, const char *buf, size_t len) {
+  if (!cprogress || !buf) return 0;
+
+  uint64_t applied_count = 0;
+  uint64_t rejected_count = 0;
+
+  const char *ptr = buf;
+  const char *end = buf + len;
+  const char *newline;
+  while (ptr < end && (newline = (const char *) memchr(ptr, '\n', end - ptr))) {
+    if (newline - ptr >= CPROGRESS_INGEST_LINEMAXLEN || _cprogress_ingest_applyline(cprogress, ptr, newline))
+      ++rejected_count;
+    else
+      ++applied_count;
+    ptr = newline + 1;
+  }
+
+  if (cprogress->ingest) {
+    cprogress->ingest->applied_count += applied_count;
+    cprogress->ingest->rejected_count += rejected_count;
+  }
+
+  return ptr - buf;
+}
+
+
+#if defined(CPROGRESS_CONFIG_NOPLATFORM) || defined(_WIN32)
+
+int cprogress_ingest_listen(cprogress_t *cprogress, const char *path) { return CPROGRESS_ERROR_UNSUPPORTED; }
+int cprogress_ingest_poll(cprogress_t *cprogress, long timeout_ms) { return -1; }
+void cprogress_ingest_close(cprogress_t *cprogress) {}
+
+#else
+
+# include "errno.h"
+# include "fcntl.h"
+# include "poll.h"
+# include "sys/socket.h"
+# include "sys/stat.h"
+# include "sys/un.h"
+
+int cprogress_ingest_listen(cprogress_t *cprogress, const char *path) {
+  if (!cprogress || cprogress->error || cprogress->ingest || !path) return CPROGRESS_ERROR_INVAL;
+
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if (strlen(path) >= sizeof(addr.sun_path)) return CPROGRESS_ERROR_BUFFUL;
+  strcpy(addr.sun_path, path);
+
+  cprogress_ingest_t *ingest = (cprogress_ingest_t *) CPROGRESS_MALLOC(sizeof(cprogress_ingest_t));
+  if (!ingest) return CPROGRESS_ERROR_INTERNAL;
+  memset(ingest, 0, sizeof(cprogress_ingest_t));
+  ingest->recv_buf = (char *) CPROGRESS_MALLOC(CPROGRESS_INGEST_RECVSIZE);
+  ingest->path = cprogress_strdup(path);
+  if (!ingest->recv_buf || !ingest->path) {
+    CPROGRESS_FREE(ingest->recv_buf);
+    CPROGRESS_FREE(ingest->path);
+    CPROGRESS_FREE(ingest);
+    return CPROGRESS_ERROR_INTERNAL;
+  }
+
+  /* a socket left behind by a previous run, never remove anything else */
+  struct stat st;
+  if (!lstat(path, &st) && S_ISSOCK(st.st_mode)) unlink(path);
+
+  ingest->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (ingest->listen_fd < 0 ||
+    bind(ingest->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+    listen(ingest->listen_fd, CPROGRESS_INGEST_MAXCLIENTS)) {
+    if (ingest->listen_fd >= 0) close(ingest->listen_fd);
+    CPROGRESS_FREE(ingest->recv_buf);
+    CPROGRESS_FREE(ingest->path);
+    CPROGRESS_FREE(ingest);
+    return CPROGRESS_ERROR_SYSTEM;
+  }
+
+  cprogress->ingest = ingest;
+  return CPROGRESS_ERROR_OK;
+}
+
+/* returns 0 once the peer is gone */
+int _cprogress_ingest_serveclient(cprogress_t *cprogress, cprogress_ingestclient_t *client) {
+  cprogress_ingest_t *ingest = cprogress->ingest;
+  char *buf = ingest->recv_buf;
+
+  /* bounded, so one busy reporter cannot starve the others */
+  for (int round = 0; round < 16; ++round) {
+    memcpy(buf, client->pending, client->pending_length);
+    size_t room = CPROGRESS_INGEST_RECVSIZE - client->pending_length;
+    ssize_t received = recv(client->fd, buf + client->pending_length, room, 0);
+    if (received == 0) return 0;
+    if (received < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+    size_t len = client->pending_length + received;
+    size_t used = cprogress_ingest_apply(cprogress, buf, len);
+
+    client->pending_length = len - used;
+    if (client->pending_length >= CPROGRESS_INGEST_LINEMAXLEN) {
+      /* far too long to be a line of ours */
+      ++ingest->rejected_count;
+      client->pending_length = 0;
+    }
+    memcpy(client->pending, buf + used, client->pending_length);
+
+    /* drained */
+    if ((size_t) received < room) break;
   }
+
+  return 1;
+}
+
+/* waits at most [timeout_ms] for reporters, returns how many updates were
+  applied, or -1 if not listening */
+int cprogress_ingest_poll(cprogress_t *cprogress, long timeout_ms) {
+  if (!cprogress || !cprogress->ingest) return -1;
+  cprogress_ingest_t *ingest = cprogress->ingest;
+
+  struct pollfd fds[CPROGRESS_INGEST_MAXCLIENTS + 1];
+  fds[0] = (struct pollfd) { .fd = ingest->listen_fd, .events = POLLIN };
+  for (size_t i = 0; i < ingest->clients_length; ++i)
+    fds[i + 1] = (struct pollfd) { .fd = ingest->clients[i].fd, .events = POLLIN };
+
+  int ready = poll(fds, ingest->clients_length + 1, (int) timeout_ms);
+  if (ready < 0) return errno == EINTR? 0: -1;
+
+  uint64_t applied_count = ingest->applied_count;
+
+  /* backwards, so that removing a client keeps the rest in place */
+  for (size_t i = ingest->clients_length; i > 0; --i) {
+    cprogress_ingestclient_t *client = &ingest->clients[i - 1];
+    if (!fds[i].revents) continue;
+    if (!_cprogress_ingest_serveclient(cprogress, client)) {
+      close(client->fd);
+      *client = ingest->clients[--ingest->clients_length];
+    }
+  }
+
+  if (fds[0].revents & POLLIN) {
+    int fd;
+    while ((fd = accept(ingest->listen_fd, NULL, NULL)) >= 0) {
+      if (ingest->clients_length >= CPROGRESS_INGEST_MAXCLIENTS) {
+        close(fd);
+        continue;
+      }
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+      ingest->clients[ingest->clients_length++] = (cprogress_ingestclient_t) { .fd = fd };
+    }
+  }
+
+  return (int) (ingest->applied_count - applied_count);
+}
+
+void cprogress_ingest_close(cprogress_t *cprogress) {
+  if (!cprogress || !cprogress->ingest) return;
+  cprogress_ingest_t *ingest = cprogress->ingest;
+
+  for (size_t i = 0; i < ingest->clients_length; ++i)
+    close(ingest->clients[i].fd);
+  close(ingest->listen_fd);
+  unlink(ingest->path);
+
+  CPROGRESS_FREE(ingest->recv_buf);
+  CPROGRESS_FREE(ingest->path);
+  CPROGRESS_FREE(ingest);
+  cprogress->ingest = NULL;
+}
+
+#endif /* CPROGRESS_CONFIG_NOPLATFORM */
+
+
+/*----------------------------------------------------------------------------
+| tick
+----------------------------------------------------------------------------*/
+
+#if defined(CPROGRESS_CONFIG_NOPLATFORM) || !defined(__linux__)
+
+int cprogress_tick_open(cprogress_t *cprogress) { return CPROGRESS_ERROR_UNSUPPORTED; }
+void cprogress_tick_close(cprogress_t *cprogress) {}
+void _cprogress_tick_markdirty(cprogress_t *cprogress) {
+  __atomic_store_n(&cprogress->is_dirty, 1, __ATOMIC_RELEASE);
+}
+void _cprogress_tick_arm(cprogress_tick_t *tick, int64_t deadline) {}
+void _cprogress_tick_drain(cprogress_tick_t *tick) {}
+
+#else
+
+# include "errno.h"
+# include "unistd.h"
+# include "sys/epoll.h"
+# include "sys/eventfd.h"
+# include "sys/timerfd.h"
+
+int cprogress_tick_open(cprogress_t *cprogress) {
+  if (!cprogress || cprogress->error) return CPROGRESS_ERROR_INVAL;
+  if (cprogress->tick) return CPROGRESS_ERROR_OK;
+
+  cprogress_tick_t *tick = (cprogress_tick_t *) CPROGRESS_MALLOC(sizeof(cprogress_tick_t));
+  if (!tick) return CPROGRESS_ERROR_INTERNAL;
+
+  /* the same clock as cprogress_nanotime() */
+  tick->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  tick->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  tick->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  struct epoll_event timer_event = { .events = EPOLLIN, .data = { .fd = tick->timer_fd } };
+  struct epoll_event event_event = { .events = EPOLLIN, .data = { .fd = tick->event_fd } };
+  if (tick->epoll_fd < 0 || tick->timer_fd < 0 || tick->event_fd < 0 ||
+    epoll_ctl(tick->epoll_fd, EPOLL_CTL_ADD, tick->timer_fd, &timer_event) ||
+    epoll_ctl(tick->epoll_fd, EPOLL_CTL_ADD, tick->event_fd, &event_event)) {
+    if (tick->epoll_fd >= 0) close(tick->epoll_fd);
+    if (tick->timer_fd >= 0) close(tick->timer_fd);
+    if (tick->event_fd >= 0) close(tick->event_fd);
+    CPROGRESS_FREE(tick);
+    return CPROGRESS_ERROR_SYSTEM;
+  }
+
+  /* the first frame is due right away */
+  cprogress->tick_ns = 0;
+  _cprogress_tick_arm(tick, 0);
+  cprogress_atomic_store(&cprogress->tick, tick);
+  return CPROGRESS_ERROR_OK;
+}
+
+/* like cprogress_destroy(...), once nothing updates the instance anymore */
+void cprogress_tick_close(cprogress_t *cprogress) {
+  if (!cprogress || !cprogress->tick) return;
+  cprogress_tick_t *tick = cprogress->tick;
+
+  cprogress_atomic_store(&cprogress->tick, NULL);
+  close(tick->epoll_fd);
+  close(tick->timer_fd);
+  close(tick->event_fd);
+  CPROGRESS_FREE(tick);
+}
+
+void _cprogress_tick_markdirty(cprogress_t *cprogress) {
+  if (__atomic_exchange_n(&cprogress->is_dirty, 1, __ATOMIC_ACQ_REL)) return;
+
+  cprogress_tick_t *tick = cprogress_atomic_load(&cprogress->tick);
+  if (tick) {
+    uint64_t one = 1;
+    ssize_t written = write(tick->event_fd, &one, sizeof(one));
+    (void) written; /* only fails when it's already readable */
+  }
+}
+
+void _cprogress_tick_arm(cprogress_tick_t *tick, int64_t deadline) {
+  struct itimerspec spec = {
+    .it_value = { .tv_sec = deadline / 1000000000LL, .tv_nsec = deadline % 1000000000LL },
+  };
+  if (deadline <= 0) spec.it_value.tv_nsec = 1; /* zero would disarm it */
+  timerfd_settime(tick->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+void _cprogress_tick_drain(cprogress_tick_t *tick) {
+  uint64_t count;
+  while (read(tick->timer_fd, &count, sizeof(count)) > 0) {}
+  while (read(tick->event_fd, &count, sizeof(count)) > 0) {}
+}
+
+#endif /* CPROGRESS_CONFIG_NOPLATFORM */
+
+
+/*----------------------------------------------------------------------------
+| io
+----------------------------------------------------------------------------*/
+
+#if defined(CPROGRESS_CONFIG_NOPLATFORM) || defined(_WIN32)
+
+int64_t cprogress_copy_fd(cprogress_t *cprogress, int task_index, int in_fd, int out_fd, int64_t length) { return -1; }
+int64_t cprogress_copy_fdcounted(cprogress_t *cprogress, int task_index, int in_fd, int out_fd, int64_t length,
+  int64_t *counted) {
+  return -1;
+}
+int cprogress_reader_open(cprogress_reader_t *reader, cprogress_t *cprogress, int task_index, int fd) {
+  return CPROGRESS_ERROR_UNSUPPORTED;
+}
+int64_t cprogress_reader_read(cprogress_reader_t *reader, void *buf, size_t length) { return -1; }
+
+#else
+
+# include "errno.h"
+# include "fcntl.h"
+# include "unistd.h"
+# include "sys/stat.h"
+# ifdef __linux__
+#  include "sys/sendfile.h"
+#  include "sys/syscall.h"
+# endif
+
+/* ways of moving bytes, tried in this order till one takes the fds */
+typedef enum {
+  _CPROGRESS_IO_COPYFILERANGE,
+  _CPROGRESS_IO_SENDFILE,
+  _CPROGRESS_IO_SPLICE,
+  _CPROGRESS_IO_BUFFER,
+} _cprogress_io_method_t;
+
+/* no _GNU_SOURCE needed */
+#define _CPROGRESS_SPLICE_F_MOVE 1
+#define _CPROGRESS_SPLICE_F_MORE 4
+
+/* the method doesn't work with these fds, nothing moved */
+int _cprogress_io_unfit(int error) {
+  return error == EINVAL || error == ENOSYS || error == EXDEV || error == EOPNOTSUPP || error == EBADF;
+}
+
+/* once, up to [length], 0 at the end, -1 with errno set */
+int64_t _cprogress_io_move(_cprogress_io_method_t method, int in_fd, int out_fd, size_t length, char *buf) {
+  switch (method) {
+#if defined(__linux__) && defined(SYS_copy_file_range)
+    case _CPROGRESS_IO_COPYFILERANGE:
+      return syscall(SYS_copy_file_range, in_fd, NULL, out_fd, NULL, length, 0);
+#endif
+#ifdef __linux__
+    case _CPROGRESS_IO_SENDFILE:
+      return sendfile(out_fd, in_fd, NULL, length);
+#endif
+#if defined(__linux__) && defined(SYS_splice)
+    case _CPROGRESS_IO_SPLICE:
+      return syscall(SYS_splice, in_fd, NULL, out_fd, NULL, length,
+        _CPROGRESS_SPLICE_F_MOVE | _CPROGRESS_SPLICE_F_MORE);
+#endif
+    case _CPROGRESS_IO_BUFFER: {
+      if (length > CPROGRESS_IO_BUFSIZE) length = CPROGRESS_IO_BUFSIZE;
+      ssize_t read_length = read(in_fd, buf, length);
+      if (read_length <= 0) return read_length;
+
+      /* what's read has to be written, even if interrupted */
+      for (ssize_t written = 0; written < read_length;) {
+        ssize_t write_length = write(out_fd, buf + written, read_length - written);
+        if (write_length < 0 && errno != EINTR) return -1;
+        if (write_length > 0) written += write_length;
+      }
+      return read_length;
+    }
+    default:
+      errno = ENOSYS;
+      return -1;
+  }
+}
+
+void _cprogress_io_report(cprogress_t *cprogress, int task_index, int64_t done, int64_t total) {
+  if (total <= 0) return;
+  float percentage = 100.0f * done / total;
+  /* 100 is for the end */
+  cprogress_updatetask_percentage(cprogress, task_index, percentage < 100? percentage: 99.99f);
+}
+
+int64_t cprogress_copy_fdcounted(cprogress_t *cprogress, int task_index, int in_fd, int out_fd, int64_t length,
+  int64_t *counted) {
+  if (!cprogress || in_fd < 0 || out_fd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  struct stat in_stat, out_stat;
+  if (fstat(in_fd, &in_stat) || fstat(out_fd, &out_stat)) return -1;
+
+  /* till the end of a regular file: known from where it's at */
+  int64_t total = length;
+  if (total < 0 && S_ISREG(in_stat.st_mode)) {
+    off_t offset = lseek(in_fd, 0, SEEK_CUR);
+    if (offset >= 0) total = in_stat.st_size > offset? in_stat.st_size - offset: 0;
+  }
+  if (S_ISREG(in_stat.st_mode)) posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  int is_piped = S_ISFIFO(in_stat.st_mode) || S_ISFIFO(out_stat.st_mode);
+  _cprogress_io_method_t method = _CPROGRESS_IO_COPYFILERANGE;
+  char *buf_alloc = NULL, *buf = NULL;
+  int64_t copied = 0, reported = 0;
+  int error = 0;
+
+  while (length < 0 || copied < length) {
+    size_t chunk = CPROGRESS_IO_CHUNKSIZE;
+    if (length >= 0 && length - copied < (int64_t) chunk) chunk = (size_t) (length - copied);
+
+    if (method == _CPROGRESS_IO_BUFFER && !buf) {
+      buf_alloc = (char *) CPROGRESS_MALLOC(CPROGRESS_IO_BUFSIZE + CPROGRESS_IO_BUFALIGN);
+      if (!buf_alloc) {
+        error = ENOMEM;
+        break;
+      }
+      buf = (char *) (((uintptr_t) buf_alloc + CPROGRESS_IO_BUFALIGN - 1) & ~(uintptr_t) (CPROGRESS_IO_BUFALIGN - 1));
+    }
+
+    int64_t moved = _cprogress_io_move(method, in_fd, out_fd, chunk, buf);
+    if (moved < 0) {
+      if (errno == EINTR) continue;
+      /* failed ones moved nothing, so the next picks up at the same offsets */
+      if (method != _CPROGRESS_IO_BUFFER && _cprogress_io_unfit(errno)) {
+        method = (_cprogress_io_method_t) (method + 1);
+        if (method == _CPROGRESS_IO_SPLICE && !is_piped) method = _CPROGRESS_IO_BUFFER;
+        continue;
+      }
+      error = errno;
+      break;
+    }
+    if (!moved) {
+      /* procfs, sysfs and some network filesystems say 0 to the kernel
+        methods with data left, only a read(2) tells for sure */
+      if (method != _CPROGRESS_IO_BUFFER && (!copied || (S_ISREG(in_stat.st_mode) && copied < total))) {
+        method = (_cprogress_io_method_t) (method + 1);
+        if (method == _CPROGRESS_IO_SPLICE && !is_piped) method = _CPROGRESS_IO_BUFFER;
+        continue;
+      }
+      break;
+    }
+
+    copied += moved;
+    if (counted) cprogress_relaxed_add(counted, moved);
+    if (copied - reported >= CPROGRESS_IO_CHUNKSIZE) {
+      _cprogress_io_report(cprogress, task_index, copied, total);
+      reported = copied;
+    }
+  }
+
+  CPROGRESS_FREE(buf_alloc);
+  if (error) {
+    errno = error;
+    return -1;
+  }
+  cprogress_updatetask_percentage(cprogress, task_index, 100);
+  return copied;
+}
+
+int64_t cprogress_copy_fd(cprogress_t *cprogress, int task_index, int in_fd, int out_fd, int64_t length) {
+  return cprogress_copy_fdcounted(cprogress, task_index, in_fd, out_fd, length, NULL);
+}
+
+void _cprogress_reader_hint(cprogress_reader_t *reader) {
+  if (reader->length < 0) return;
+  if (reader->hinted_offset - reader->offset > CPROGRESS_IO_READAHEAD / 2) return;
+  if (reader->hinted_offset >= reader->length) return;
+
+  posix_fadvise(reader->fd, reader->base + reader->hinted_offset, CPROGRESS_IO_READAHEAD, POSIX_FADV_WILLNEED);
+  reader->hinted_offset += CPROGRESS_IO_READAHEAD;
+}
+
+int cprogress_reader_open(cprogress_reader_t *reader, cprogress_t *cprogress, int task_index, int fd) {
+  if (!reader || !cprogress || fd < 0) return CPROGRESS_ERROR_INVAL;
+
+  struct stat fd_stat;
+  if (fstat(fd, &fd_stat)) return CPROGRESS_ERROR_SYSTEM;
+
+  reader->cprogress = cprogress;
+  reader->task_index = task_index;
+  reader->fd = fd;
+  reader->base = 0;
+  reader->length = -1;
+  reader->offset = reader->reported_offset = reader->hinted_offset = 0;
+
+  if (S_ISREG(fd_stat.st_mode)) {
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if (offset >= 0) {
+      reader->base = offset;
+      reader->length = fd_stat.st_size > offset? fd_stat.st_size - offset: 0;
+      posix_fadvise(fd, offset, 0, POSIX_FADV_SEQUENTIAL);
+      _cprogress_reader_hint(reader);
+    }
+  }
+  return CPROGRESS_ERROR_OK;
+}
+
+int64_t cprogress_reader_read(cprogress_reader_t *reader, void *buf, size_t length) {
+  if (!reader || !buf) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  ssize_t read_length;
+  do read_length = read(reader->fd, buf, length);
+  while (read_length < 0 && errno == EINTR);
+  if (read_length < 0) return -1;
+
+  reader->offset += read_length;
+  if ((!read_length && length) || (reader->length >= 0 && reader->offset >= reader->length)) {
+    cprogress_updatetask_percentage(reader->cprogress, reader->task_index, 100);
+  } else if (reader->offset - reader->reported_offset >= CPROGRESS_IO_CHUNKSIZE) {
+    _cprogress_io_report(reader->cprogress, reader->task_index, reader->offset, reader->length);
+    reader->reported_offset = reader->offset;
+  }
+  _cprogress_reader_hint(reader);
+  return read_length;
+}
+
+#endif /* CPROGRESS_CONFIG_NOPLATFORM */
+
+
+/*----------------------------------------------------------------------------
+| log
+----------------------------------------------------------------------------*/
+
+int cprogress_openlog(cprogress_t *cprogress, size_t queue_length, cprogress_logpolicy_t policy) {
+  if (!cprogress) return CPROGRESS_ERROR_INVAL;
+  if (cprogress->log) return CPROGRESS_ERROR_OK;
+
+  cprogress_mpsc_t *log = (cprogress_mpsc_t *) CPROGRESS_MALLOC(sizeof(cprogress_mpsc_t));
+  if (!log) return CPROGRESS_ERROR_INTERNAL;
+
+  int error = cprogress_mpsc_create(log, queue_length? queue_length: CPROGRESS_LOG_QUEUELENGTH, sizeof(cprogress_logrecord_t));
+  if (error) {
+    CPROGRESS_FREE(log);
+    return error;
+  }
+
+  cprogress->log_policy = policy;
+  cprogress->log_thread = cprogress_thread_self();
+  cprogress->log = log;
+  return CPROGRESS_ERROR_OK;
+}
+
+int cprogress_vlog(cprogress_t *cprogress, const char *fmt, va_list va) {
+  if (!cprogress || !fmt) return CPROGRESS_ERROR_INVAL;
+
+  cprogress_logrecord_t record;
+  vsnprintf(record.line, CPROGRESS_LOG_LINEMAXLEN, fmt, va);
+
+  if (!cprogress->log) {
+    cprogress_console_resetline();
+    cprogress_console_eraseline();
+    puts(record.line);
+    return CPROGRESS_ERROR_OK;
+  }
+
+  for (int spins = 0; !cprogress_mpsc_trypush(cprogress->log, &record); ) {
+    /* nobody else would drain it for the draining thread, which can't
+      write over a frame it is in the middle of */
+    uint64_t self = cprogress_thread_self();
+    int is_draining = self && self == cprogress_relaxed_load(&cprogress->log_thread);
+    if (is_draining && !cprogress->is_rendering) {
+      _cprogress_drainlog(cprogress);
+      _cprogress_frame_flush(cprogress);
+      continue;
+    }
+    if (cprogress->log_policy == CPROGRESS_LOG_DROP || !self || is_draining) {
+      cprogress_relaxed_add(&cprogress->log_dropped_count, 1);
+      return CPROGRESS_ERROR_BUFFUL;
+    }
+
+    /* wait for the renderer to drain it */
+    if (++spins < 64) cprogress_cpu_relax();
+    else cprogress_yield();
+  }
+
+  return CPROGRESS_ERROR_OK;
+}
+
+int cprogress_log(cprogress_t *cprogress, const char *fmt, ...) {
+  va_list va;
+  va_start(va, fmt);
+  int error = cprogress_vlog(cprogress, fmt, va);
+  va_end(va);
+  return error;
 }
 
 
@@ -0,0 +1,423 @@
+/*
+  CPROGRESS - C++ wrapper
+  2024 @ Julian Droske
+
+
+  INTRODUCTION
+  ============
+
+  Owning types over cprogress.h, for C++17 and later. Everything is inline
+  and noexcept, forwarding to the C functions, so updates cost the same as
+  calling them directly. The implementation still has to be included once
+  in a C or C++ file, see IMPORTING in cprogress.h.
+
+  | #include "cprogress.hpp"
+  |
+  | cprogress::instance progress("$=t [$40b#] $p%", 0);
+  | {
+  |   cprogress::task_guard task(progress);
+  |   task.update_title(name); // a std::string_view, no copy to terminate
+  |   task.update_percentage(42);
+  | } // finished here
+  |
+  | progress.render_tillcomplete(30);
+
+
+  INSTANCE
+  ========
+
+  cprogress::instance owns what cprogress_create(...) returns and calls
+  cprogress_destroy(...) when it goes away. It can be moved but not copied.
+  The cprogress_t itself lives on the heap and never moves, so handles and
+  guards made from an instance stay valid when the instance is moved. An
+  instance that failed to be created, or was moved from, converts to false
+  and [error()] tells why.
+
+  [get()] gives the cprogress_t * for anything the wrapper leaves out.
+
+
+  TASK GUARD
+  ==========
+
+  cprogress::task_guard starts a task when constructed and finishes it,
+  i.e. sets it to 100%, when destroyed, unless it has been aborted. Made
+  from an instance alone, it acquires a slot and releases it afterwards
+  (see DYNAMIC TASKS in cprogress.h). Made with an index, it runs one of the
+  tasks the instance was created with. It can be moved but not copied.
+
+  Guards must go away before their instance, as C requires tasks to be
+  done with before cprogress_destroy(...). Declaring the instance first in
+  a scope or a class is enough for that.
+
+
+  TRACKING LOOPS
+  ==============
+
+  | for (auto &item : cprogress::track(progress, task_index, items)) ...
+
+  sets the task to how far the loop has gone through [items], any range
+  whose iterators can be walked more than once. Its length is taken once
+  up front, in constant time for random access ones. Rather than every
+  element, the task is only updated once per step that can be seen, a
+  1 / track_steps of the length, or every [stride] elements when given, so
+  the loop itself pays a decrement and a branch per element. The last
+  element sets it to 100%, which finishes the task, breaking out before
+  leaves it where it was. The task has to be started already.
+
+
+  COROUTINES
+  ==========
+
+  With C++20 coroutines, rendering and reporting fit in whatever executor
+  runs them, without blocking one of its threads. All it takes is a
+  scheduler, anything with:
+
+  | void schedule_at(std::coroutine_handle<> handle, int64_t deadline);
+
+  that resumes [handle] on one of its threads once cprogress_nanotime()
+  reaches [deadline], e.g. a timer on the reactor. Then:
+
+  | while (progress.still_running())
+  |   co_await progress.next_frame(scheduler, 30);
+
+  draws a frame if one is due, see cprogress_tick(...) in cprogress.h, and
+  comes back for the next one, at [fps] at most, 1 when not positive. Tasks, each coroutine
+  owning a task_guard of its own if need be, report with:
+
+  | if (!co_await task.report(delta)) co_return;
+
+  which adds [delta] and never suspends, and is false once the task is not
+  running anymore, finished or aborted, so aborting a task can stop its
+  coroutine. Only built when the compiler has coroutines and concepts.
+*/
+
+
+#ifndef CPROGRESS_HPP
+#define CPROGRESS_HPP
+
+
+
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <string_view>
+#include <utility>
+
+#include "cprogress.h"
+
+#if defined(__cpp_impl_coroutine) && defined(__cpp_concepts)
+# define CPROGRESS_HPP_COROUTINES
+# include <concepts>
+# include <coroutine>
+#endif
+
+
+namespace cprogress {
+
+
+/*----------------------------------------------------------------------------
+| coroutines
+----------------------------------------------------------------------------*/
+
+#ifdef CPROGRESS_HPP_COROUTINES
+
+template <typename Scheduler>
+concept scheduler = requires(Scheduler &scheduler, std::coroutine_handle<> handle, int64_t deadline) {
+  scheduler.schedule_at(handle, deadline);
+};
+
+template <scheduler Scheduler>
+class frame_awaitable {
+public:
+  /* it has to come back at some point, so [fps] is 1 at least */
+  frame_awaitable(cprogress_t *cprogress, Scheduler &scheduler, int fps) noexcept
+    : cprogress_(cprogress), scheduler_(scheduler), fps_(fps > 0? fps: 1) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  /* updates don't wake it up early, so come back at [fps] at most even
+    when nothing is due before */
+  void await_suspend(std::coroutine_handle<> handle) noexcept {
+    int64_t deadline = cprogress_tick(cprogress_, fps_);
+    int64_t frame_deadline = cprogress_nanotime() + 1000000000LL / fps_;
+    /* no instance, nothing due */
+    if (deadline == CPROGRESS_UNDEF || deadline > frame_deadline) deadline = frame_deadline;
+    scheduler_.schedule_at(handle, deadline);
+  }
+
+  void await_resume() const noexcept {}
+
+private:
+  cprogress_t *cprogress_;
+  Scheduler &scheduler_;
+  int fps_;
+};
+
+/* already done by the time it is awaited */
+class report_awaitable {
+public:
+  explicit report_awaitable(bool is_running) noexcept : is_running_(is_running) {}
+
+  bool await_ready() const noexcept { return true; }
+  void await_suspend(std::coroutine_handle<>) const noexcept {}
+  bool await_resume() const noexcept { return is_running_; }
+
+private:
+  bool is_running_;
+};
+
+#endif /* CPROGRESS_HPP_COROUTINES */
+
+
+/*----------------------------------------------------------------------------
+| instance
+----------------------------------------------------------------------------*/
+
+class instance {
+public:
+  instance(const char *fmt, int task_count) noexcept
+    : cprogress_(new (std::nothrow) cprogress_t(cprogress_create(fmt, task_count))) {}
+
+  instance(instance &&other) noexcept : cprogress_(std::exchange(other.cprogress_, nullptr)) {}
+
+  instance &operator=(instance &&other) noexcept {
+    if (this != &other) {
+      reset();
+      cprogress_ = std::exchange(other.cprogress_, nullptr);
+    }
+    return *this;
+  }
+
+  instance(const instance &) = delete;
+  instance &operator=(const instance &) = delete;
+
+  ~instance() noexcept { reset(); }
+
+  cprogress_t *get() const noexcept { return cprogress_; }
+  cprogress_error_t error() const noexcept {
+    return cprogress_? cprogress_->error: CPROGRESS_ERROR_INTERNAL;
+  }
+  explicit operator bool() const noexcept { return cprogress_ && !cprogress_->error; }
+
+  /* fixed tasks */
+  void start_task(int task_index) noexcept { cprogress_starttask(cprogress_, task_index); }
+  void abort_task(int task_index) noexcept { cprogress_aborttask(cprogress_, task_index); }
+  void start_all_tasks() noexcept { cprogress_startalltasks(cprogress_); }
+
+  void update_title(int task_index, std::string_view title) noexcept {
+    cprogress_updatetask_titlen(cprogress_, task_index, title.data(), title.size());
+  }
+  void update_percentage(int task_index, float percentage) noexcept {
+    cprogress_updatetask_percentage(cprogress_, task_index, percentage);
+  }
+  void add_percentage(int task_index, float delta) noexcept {
+    cprogress_updatetask_addpercentage(cprogress_, task_index, delta);
+  }
+
+  /* rendering */
+  bool still_running() noexcept { return cprogress_stillrunning(cprogress_); }
+  void render() noexcept {
+    cprogress_beginrender(cprogress_);
+    cprogress_render(cprogress_);
+    cprogress_endrender(cprogress_);
+  }
+  void render_tillcomplete(int fps) noexcept { cprogress_render_tillcomplete(cprogress_, fps); }
+  void wait_fps(int fps) noexcept { cprogress_waitfps(cprogress_, fps); }
+  void abort() noexcept { cprogress_abort(cprogress_); }
+
+#ifdef CPROGRESS_HPP_COROUTINES
+  template <scheduler Scheduler>
+  frame_awaitable<Scheduler> next_frame(Scheduler &scheduler, int fps) noexcept {
+    return frame_awaitable<Scheduler>(cprogress_, scheduler, fps);
+  }
+#endif
+
+private:
+  void reset() noexcept {
+    if (!cprogress_) return;
+    cprogress_destroy(cprogress_);
+    delete cprogress_;
+    cprogress_ = nullptr;
+  }
+
+  cprogress_t *cprogress_;
+};
+
+
+/*----------------------------------------------------------------------------
+| task guard
+----------------------------------------------------------------------------*/
+
+class task_guard {
+public:
+  /* an acquired slot, released when done */
+  explicit task_guard(instance &progress) noexcept
+    : task_(cprogress_task_acquire(progress.get())), is_acquired_(true) {
+    cprogress_task_start(task_);
+  }
+
+  /* one of the tasks [progress] was created with */
+  task_guard(instance &progress, int task_index) noexcept
+    : task_{ progress.get(), task_index, 0 }, is_acquired_(false) {
+    cprogress_starttask(task_.cprogress, task_index);
+  }
+
+  task_guard(task_guard &&other) noexcept
+    : task_(std::exchange(other.task_, cprogress_taskhandle_t{})), is_acquired_(other.is_acquired_) {}
+
+  task_guard &operator=(task_guard &&other) noexcept {
+    if (this != &other) {
+      finish();
+      task_ = std::exchange(other.task_, cprogress_taskhandle_t{});
+      is_acquired_ = other.is_acquired_;
+    }
+    return *this;
+  }
+
+  task_guard(const task_guard &) = delete;
+  task_guard &operator=(const task_guard &) = delete;
+
+  ~task_guard() noexcept { finish(); }
+
+  /* its index as given to event subscribers */
+  int index() const noexcept { return task_.index; }
+  explicit operator bool() const noexcept { return task_.cprogress != nullptr; }
+
+  void update_title(std::string_view title) noexcept {
+    if (is_acquired_) cprogress_task_updatetitlen(task_, title.data(), title.size());
+    else cprogress_updatetask_titlen(task_.cprogress, task_.index, title.data(), title.size());
+  }
+  void update_percentage(float percentage) noexcept {
+    if (is_acquired_) cprogress_task_updatepercentage(task_, percentage);
+    else cprogress_updatetask_percentage(task_.cprogress, task_.index, percentage);
+  }
+  void add_percentage(float delta) noexcept {
+    if (is_acquired_) cprogress_task_addpercentage(task_, delta);
+    else cprogress_updatetask_addpercentage(task_.cprogress, task_.index, delta);
+  }
+
+  bool is_running() const noexcept {
+    if (is_acquired_) return cprogress_task_isrunning(task_);
+    return task_.cprogress && task_.index >= 0 && task_.index < (int) task_.cprogress->taskinfos_length &&
+      cprogress_taskinfo_isrunning(&cprogress_gettaskinfo(task_.cprogress, task_.index));
+  }
+
+#ifdef CPROGRESS_HPP_COROUTINES
+  report_awaitable report(float delta) noexcept {
+    add_percentage(delta);
+    return report_awaitable(is_running());
+  }
+#endif
+
+  /* drawn as aborted, the guard finishes nothing afterwards */
+  void abort() noexcept {
+    if (is_acquired_) cprogress_task_abort(task_);
+    else cprogress_aborttask(task_.cprogress, task_.index);
+  }
+
+private:
+  /* an aborted task is not running anymore, so this leaves it as is */
+  void finish() noexcept {
+    if (!task_.cprogress) return;
+    update_percentage(100);
+    if (is_acquired_) cprogress_task_release(task_);
+    task_ = cprogress_taskhandle_t{};
+  }
+
+  cprogress_taskhandle_t task_;
+  bool is_acquired_;
+};
+
+
+/*----------------------------------------------------------------------------
+| track
+----------------------------------------------------------------------------*/
+
+/* steps a tracked loop is updated in, 0.01% is as fine as $p shows */
+constexpr std::size_t track_steps = 10000;
+
+template <typename Range>
+class track_range {
+  using base_iterator = decltype(std::begin(std::declval<Range &>()));
+
+public:
+  class iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using difference_type = typename std::iterator_traits<base_iterator>::difference_type;
+    using value_type = typename std::iterator_traits<base_iterator>::value_type;
+    using pointer = typename std::iterator_traits<base_iterator>::pointer;
+    using reference = typename std::iterator_traits<base_iterator>::reference;
+
+    iterator(base_iterator it, track_range *range, std::size_t countdown) noexcept
+      : it_(it), range_(range), countdown_(countdown) {}
+
+    reference operator*() const noexcept { return *it_; }
+    pointer operator->() const noexcept { return &*it_; }
+
+    iterator &operator++() noexcept {
+      ++it_;
+      if (--countdown_ == 0) countdown_ = range_->step();
+      return *this;
+    }
+
+    bool operator==(const iterator &other) const noexcept { return it_ == other.it_; }
+    bool operator!=(const iterator &other) const noexcept { return it_ != other.it_; }
+
+  private:
+    base_iterator it_;
+    track_range *range_;
+    std::size_t countdown_; /* elements till the next update */
+  };
+
+  track_range(Range &&range, cprogress_t *cprogress, int task_index, std::size_t stride) noexcept
+    : range_(std::forward<Range>(range)), cprogress_(cprogress), task_index_(task_index) {
+    length_ = (std::size_t) std::distance(std::begin(range_), std::end(range_));
+    stride_ = stride? stride: length_ / track_steps;
+    if (!stride_) stride_ = 1;
+  }
+
+  iterator begin() noexcept {
+    position_ = 0;
+    if (!length_) cprogress_updatetask_percentage(cprogress_, task_index_, 100);
+    return iterator(std::begin(range_), this, next_countdown());
+  }
+  iterator end() noexcept { return iterator(std::end(range_), this, 0); }
+
+private:
+  /* [countdown] elements went by */
+  std::size_t step() noexcept {
+    position_ += position_ + stride_ < length_? stride_: length_ - position_;
+    cprogress_updatetask_percentage(cprogress_, task_index_, (float) (100.0 * position_ / length_));
+    return next_countdown();
+  }
+
+  std::size_t next_countdown() const noexcept {
+    std::size_t left = length_ - position_;
+    /* never reached, the loop ends first */
+    if (!left) return (std::size_t) -1;
+    return left < stride_? left: stride_;
+  }
+
+  Range range_; /* a reference unless given a temporary */
+  cprogress_t *cprogress_;
+  int task_index_;
+  std::size_t length_;
+  std::size_t stride_;
+  std::size_t position_ = 0;
+};
+
+template <typename Range>
+track_range<Range> track(cprogress_t *cprogress, int task_index, Range &&range, std::size_t stride = 0) noexcept {
+  return track_range<Range>(std::forward<Range>(range), cprogress, task_index, stride);
+}
+
+template <typename Range>
+track_range<Range> track(instance &progress, int task_index, Range &&range, std::size_t stride = 0) noexcept {
+  return track_range<Range>(std::forward<Range>(range), progress.get(), task_index, stride);
+}
+
+
+} /* namespace cprogress */
+
+#endif /* !CPROGRESS_HPP */
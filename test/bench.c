@@ -0,0 +1,492 @@
+#include "stdio.h"
+#include "stdint.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+#include "unistd.h"
+#include "fcntl.h"
+#include "pthread.h"
+#ifdef __linux__
+# include "sys/syscall.h"
+#endif
+
+
+/* count every allocation the library makes */
+
+static uint64_t bench_alloc_count = 0;
+
+void *bench_malloc(size_t size) {
+  __atomic_add_fetch(&bench_alloc_count, 1, __ATOMIC_RELAXED);
+  return malloc(size);
+}
+
+void *bench_realloc(void *ptr, size_t size) {
+  __atomic_add_fetch(&bench_alloc_count, 1, __ATOMIC_RELAXED);
+  return realloc(ptr, size);
+}
+
+#define CPROGRESS_MALLOC(size) bench_malloc(size)
+#define CPROGRESS_REALLOC(ptr, size) bench_realloc(ptr, size)
+#define CPROGRESS_FREE(ptr) free(ptr)
+
+#define CPROGRESS_IMPL
+#include "../cprogress.h"
+
+
+/* harness */
+
+
+#define BENCH_TARGET_NS 200000000LL /* per measurement */
+#define BENCH_REPEAT 5
+
+typedef void (bench_func_t (void *ctx, long iterations));
+
+static const char *bench_filter = NULL;
+static FILE *bench_out = NULL; /* stdout may point to /dev/null meanwhile */
+
+int64_t bench_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int bench_compare_double(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return x < y? -1: x > y;
+}
+
+/* runs [func] long enough to be stable, prints the median of a few runs */
+void bench_run(const char *name, bench_func_t *func, void *ctx) {
+  if (bench_filter && !strstr(name, bench_filter)) return;
+
+  /* calibrate */
+  long iterations = 1;
+  int64_t elapsed = 0;
+  while (1) {
+    int64_t begin = bench_now();
+    func(ctx, iterations);
+    elapsed = bench_now() - begin;
+    if (elapsed >= BENCH_TARGET_NS / 10 || iterations >= (1L << 30)) break;
+    iterations *= elapsed > 0 && elapsed < BENCH_TARGET_NS / 100? 10: 2;
+  }
+  if (elapsed > 0 && elapsed < BENCH_TARGET_NS)
+    iterations = (long) ((double) iterations * BENCH_TARGET_NS / elapsed);
+  if (iterations < 1) iterations = 1;
+
+  double ns_per_op[BENCH_REPEAT];
+  double allocs_per_op = 0;
+  for (int i = 0; i < BENCH_REPEAT; ++i) {
+    uint64_t allocs = __atomic_load_n(&bench_alloc_count, __ATOMIC_RELAXED);
+    int64_t begin = bench_now();
+    func(ctx, iterations);
+    ns_per_op[i] = (double) (bench_now() - begin) / iterations;
+    allocs_per_op = (double) (__atomic_load_n(&bench_alloc_count, __ATOMIC_RELAXED) - allocs) / iterations;
+  }
+  qsort(ns_per_op, BENCH_REPEAT, sizeof(double), bench_compare_double);
+
+  fprintf(bench_out, "%-64s %12.1f %10.2f\n", name, ns_per_op[BENCH_REPEAT / 2], allocs_per_op);
+  fflush(bench_out);
+}
+
+
+/* keep the compiler from dropping results */
+static volatile size_t bench_sink;
+
+static const char *bench_formats[] = {
+  "$=t [$40b#] $p%",
+  "$20t [$=b#] $6p%",
+  "[$=b=] $p% done, $20t",
+  "job: $10t | progress: $30b* | $p% | eta unknown",
+  "$=t [$30b#] $16s $p%",
+  "$k $=t [$30b#] $Q $p%",
+  "${dim}[${state}$40b#${dim}]${} ${bold}$=t${} $p%",
+};
+#define BENCH_FORMATS_LENGTH (sizeof(bench_formats) / sizeof(bench_formats[0]))
+
+
+/* custom conversions, one of each width contract */
+
+size_t bench_conversion_shard(char *buf, size_t buf_len, size_t alloc_width,
+  cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo, void *userdata) {
+  return snprintf(buf, buf_len, "#%02d", taskinfo? cprogress_taskinfo_getindex(taskinfo) % 100: 0);
+}
+
+size_t bench_conversion_depth(char *buf, size_t buf_len, size_t alloc_width,
+  cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo, void *userdata) {
+  size_t length = (size_t) snprintf(buf, buf_len, "q=%zu", (size_t) bench_sink % 100000);
+  return length < buf_len? length: buf_len - 1;
+}
+
+
+/* cprogress_create */
+
+void bench_create(void *ctx, long iterations) {
+  const char *fmt = (const char *) ctx;
+  for (long i = 0; i < iterations; ++i) {
+    cprogress_t cprogress = cprogress_create(fmt, 4);
+    bench_sink += cprogress.displaychunks_length;
+    cprogress_destroy(&cprogress);
+  }
+}
+
+
+/* cprogress_writeline */
+
+typedef struct {
+  cprogress_t *cprogress;
+  char *buf;
+  size_t buf_len;
+  size_t width;
+} bench_writeline_t;
+
+void bench_writeline(void *ctx, long iterations) {
+  bench_writeline_t *bw = (bench_writeline_t *) ctx;
+  for (long i = 0; i < iterations; ++i) {
+    cprogress_writeline(bw->cprogress, bw->buf, bw->buf_len, bw->width, "Simple task", (float) (i % 10000) / 100);
+    bench_sink += bw->buf[0];
+  }
+}
+
+
+/* cprogress_writepercentage */
+
+void bench_writepercentage(void *ctx, long iterations) {
+  char buf[16];
+  for (long i = 0; i < iterations; ++i)
+    bench_sink += cprogress_writepercentage(buf, sizeof(buf), (float) (i % 10000) / 100, 7);
+}
+
+
+/* update latency */
+
+void bench_update(void *ctx, long iterations) {
+  cprogress_t *cprogress = (cprogress_t *) ctx;
+  for (long i = 0; i < iterations; ++i)
+    cprogress_updatetask_percentage(cprogress, 0, (float) (i % 9000) / 100);
+}
+
+/* steps far below a digit or a bar cell, none of them worth a frame */
+void bench_update_subvisible(void *ctx, long iterations) {
+  cprogress_t *cprogress = (cprogress_t *) ctx;
+  for (long i = 0; i < iterations; ++i)
+    cprogress_updatetask_percentage(cprogress, 1, 50 + (float) (i % 1000) / 1000000);
+}
+
+void bench_update_handle(void *ctx, long iterations) {
+  cprogress_taskhandle_t *task = (cprogress_taskhandle_t *) ctx;
+  for (long i = 0; i < iterations; ++i)
+    cprogress_task_updatepercentage(*task, (float) (i % 9000) / 100);
+}
+
+/* acquire, start, release, the slot comes back from the free list */
+void bench_acquire(void *ctx, long iterations) {
+  cprogress_t *cprogress = (cprogress_t *) ctx;
+  for (long i = 0; i < iterations; ++i) {
+    cprogress_taskhandle_t task = cprogress_task_acquire(cprogress);
+    cprogress_task_start(task);
+    cprogress_task_release(task);
+  }
+}
+
+typedef struct {
+  cprogress_t *cprogress;
+  int thread_count;
+  int is_shared; /* all threads hit task 0 */
+} bench_contended_t;
+
+typedef struct {
+  bench_contended_t *bc;
+  int thread_index;
+  long iterations;
+  pthread_barrier_t *barrier;
+} bench_contended_worker_t;
+
+void *bench_contended_worker(void *userdata) {
+  bench_contended_worker_t *worker = (bench_contended_worker_t *) userdata;
+  cprogress_t *cprogress = worker->bc->cprogress;
+  int task_index = worker->bc->is_shared? 0: worker->thread_index;
+
+  pthread_barrier_wait(worker->barrier);
+  for (long i = 0; i < worker->iterations; ++i)
+    cprogress_updatetask_percentage(cprogress, task_index, (float) (i % 9000) / 100);
+  return NULL;
+}
+
+/* every thread does [iterations] updates, so ns/op is the latency one
+  updater sees with the others running */
+void bench_contended(void *ctx, long iterations) {
+  bench_contended_t *bc = (bench_contended_t *) ctx;
+
+  pthread_t threads[64];
+  bench_contended_worker_t workers[64];
+  pthread_barrier_t barrier;
+  pthread_barrier_init(&barrier, NULL, bc->thread_count);
+
+  for (int i = 1; i < bc->thread_count; ++i) {
+    workers[i] = (bench_contended_worker_t) { bc, i, iterations, &barrier };
+    pthread_create(&threads[i], NULL, bench_contended_worker, &workers[i]);
+  }
+  workers[0] = (bench_contended_worker_t) { bc, 0, iterations, &barrier };
+  bench_contended_worker(&workers[0]);
+
+  for (int i = 1; i < bc->thread_count; ++i)
+    pthread_join(threads[i], NULL);
+  pthread_barrier_destroy(&barrier);
+}
+
+
+/* cprogress::track, see bench_track.cpp */
+
+void *bench_track_create(cprogress_t *cprogress, size_t length);
+void bench_track_destroy(void *ctx);
+void bench_track_bare(void *ctx, long iterations);
+void bench_track_tracked(void *ctx, long iterations);
+
+
+/* cprogress_copy_fd and readers, per file, against the bare loops */
+
+#define BENCH_IO_LENGTH (64L << 20)
+
+typedef struct {
+  cprogress_t *cprogress;
+  int in_fd;
+  int out_fd;
+  char *buf;
+} bench_io_t;
+
+/* unlinked right away, so nothing's left behind */
+int bench_io_tempfile(long length) {
+  char path[] = "/tmp/cprogress-bench-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) return -1;
+  unlink(path);
+
+  char block[4096];
+  for (size_t i = 0; i < sizeof(block); ++i) block[i] = (char) i;
+  for (long written = 0; written < length; written += sizeof(block)) {
+    if (write(fd, block, sizeof(block)) != sizeof(block)) {
+      close(fd);
+      return -1;
+    }
+  }
+  return fd;
+}
+
+void bench_io_rewind(bench_io_t *bi) {
+  lseek(bi->in_fd, 0, SEEK_SET);
+  lseek(bi->out_fd, 0, SEEK_SET);
+}
+
+#ifdef __linux__
+void bench_copy_bare(void *ctx, long iterations) {
+  bench_io_t *bi = (bench_io_t *) ctx;
+  for (long i = 0; i < iterations; ++i) {
+    bench_io_rewind(bi);
+    for (long copied = 0; copied < BENCH_IO_LENGTH;) {
+      long moved = syscall(SYS_copy_file_range, bi->in_fd, NULL, bi->out_fd, NULL, BENCH_IO_LENGTH - copied, 0);
+      if (moved <= 0) break;
+      copied += moved;
+    }
+  }
+}
+#endif
+
+void bench_copy_fd(void *ctx, long iterations) {
+  bench_io_t *bi = (bench_io_t *) ctx;
+  for (long i = 0; i < iterations; ++i) {
+    bench_io_rewind(bi);
+    cprogress_updatetask_percentage(bi->cprogress, 0, 0);
+    bench_sink += cprogress_copy_fd(bi->cprogress, 0, bi->in_fd, bi->out_fd, -1);
+  }
+}
+
+void bench_read_bare(void *ctx, long iterations) {
+  bench_io_t *bi = (bench_io_t *) ctx;
+  for (long i = 0; i < iterations; ++i) {
+    bench_io_rewind(bi);
+    while (read(bi->in_fd, bi->buf, CPROGRESS_IO_BUFSIZE) > 0) bench_sink += bi->buf[0];
+  }
+}
+
+void bench_read_reader(void *ctx, long iterations) {
+  bench_io_t *bi = (bench_io_t *) ctx;
+  for (long i = 0; i < iterations; ++i) {
+    bench_io_rewind(bi);
+    cprogress_updatetask_percentage(bi->cprogress, 0, 0);
+    cprogress_reader_t reader;
+    /* nothing to time without one */
+    if (cprogress_reader_open(&reader, bi->cprogress, 0, bi->in_fd) != CPROGRESS_ERROR_OK) break;
+    while (cprogress_reader_read(&reader, bi->buf, CPROGRESS_IO_BUFSIZE) > 0) bench_sink += bi->buf[0];
+  }
+}
+
+
+/* cprogress_parallel_for, per item, against the same loop on one thread */
+
+static uint64_t bench_parallel_sums[CPROGRESS_PARALLEL_MAXWORKERS * 8]; /* a cache line each */
+
+void bench_parallel_sum(long begin, long end, int worker_index, void *ctx) {
+  uint64_t sum = 0;
+  for (long i = begin; i < end; ++i) sum += (uint64_t) i * i;
+  bench_parallel_sums[worker_index * 8] += sum;
+}
+
+void bench_parallel_serial(void *ctx, long iterations) {
+  bench_parallel_sum(0, iterations, 0, NULL);
+  bench_sink += bench_parallel_sums[0];
+}
+
+void bench_parallel(void *ctx, long iterations) {
+  cprogress_parallel_for((cprogress_t *) ctx, 0, iterations, 0, bench_parallel_sum, NULL);
+  bench_sink += bench_parallel_sums[0];
+}
+
+
+/* full frame against a null sink, as if something changed every time */
+
+void bench_render(void *ctx, long iterations) {
+  cprogress_t *cprogress = (cprogress_t *) ctx;
+  for (long i = 0; i < iterations; ++i) {
+    __atomic_store_n(&cprogress->is_dirty, 1, __ATOMIC_RELAXED);
+    cprogress_beginrender_consolewidth(cprogress, 80);
+    cprogress_render(cprogress);
+    cprogress_endrender(cprogress);
+  }
+}
+
+/* nothing changed since the last one */
+void bench_render_clean(void *ctx, long iterations) {
+  cprogress_t *cprogress = (cprogress_t *) ctx;
+  for (long i = 0; i < iterations; ++i) {
+    cprogress_beginrender_consolewidth(cprogress, 80);
+    cprogress_render(cprogress);
+    cprogress_endrender(cprogress);
+  }
+}
+
+
+int main(int argc, char **argv) {
+  if (argc > 1) bench_filter = argv[1];
+  bench_out = fdopen(dup(STDOUT_FILENO), "w");
+
+  cprogress_registerconversion('k', bench_conversion_shard, NULL, CPROGRESS_CONVERSION_FIXEDWIDTH, 3);
+  cprogress_registerconversion('Q', bench_conversion_depth, NULL, CPROGRESS_CONVERSION_MAXWIDTH, 8);
+
+  char name[128];
+  fprintf(bench_out, "%-64s %12s %10s\n", "benchmark", "ns/op", "allocs/op");
+
+  for (size_t i = 0; i < BENCH_FORMATS_LENGTH; ++i) {
+    snprintf(name, sizeof(name), "create+destroy \"%s\"", bench_formats[i]);
+    bench_run(name, bench_create, (void *) bench_formats[i]);
+  }
+
+  static const size_t widths[] = { 40, 80, 200, 1000 };
+  for (size_t i = 0; i < BENCH_FORMATS_LENGTH; ++i) {
+    cprogress_t cprogress = cprogress_create(bench_formats[i], 1);
+    for (size_t j = 0; j < sizeof(widths) / sizeof(widths[0]); ++j) {
+      size_t buf_len = widths[j] * 4 + 1;
+      bench_writeline_t bw = { &cprogress, (char *) malloc(buf_len), buf_len, widths[j] };
+      snprintf(name, sizeof(name), "writeline/%zu \"%s\"", widths[j], bench_formats[i]);
+      bench_run(name, bench_writeline, &bw);
+      free(bw.buf);
+    }
+    cprogress_destroy(&cprogress);
+  }
+
+  bench_run("writepercentage", bench_writepercentage, NULL);
+
+  {
+    cprogress_t cprogress = cprogress_create("$=t [$40b#] $p%", 64);
+    cprogress_startalltasks(&cprogress);
+
+    bench_run("update/single", bench_update, &cprogress);
+    bench_run("update/single/subvisible", bench_update_subvisible, &cprogress);
+
+    cprogress_taskhandle_t task = cprogress_task_acquire(&cprogress);
+    cprogress_task_start(task);
+    bench_run("update/handle", bench_update_handle, &task);
+    cprogress_task_release(task);
+    bench_run("acquire+start+release", bench_acquire, &cprogress);
+
+    /* per element, over 1M at a time */
+    void *bt = bench_track_create(&cprogress, 1 << 20);
+    bench_run("track/bare loop", bench_track_bare, bt);
+    bench_run("track/tracked loop", bench_track_tracked, bt);
+    bench_track_destroy(bt);
+
+    cprogress_setparallel(&cprogress, 0, CPROGRESS_PARALLEL_NORENDER);
+    bench_run("parallel_for/serial loop", bench_parallel_serial, NULL);
+    snprintf(name, sizeof(name), "parallel_for/%d workers", cprogress_cpu_count());
+    bench_run(name, bench_parallel, &cprogress);
+
+    /* per 64M file, in the page cache */
+    bench_io_t bi = { &cprogress, bench_io_tempfile(BENCH_IO_LENGTH), bench_io_tempfile(0), malloc(CPROGRESS_IO_BUFSIZE) };
+    if (bi.in_fd >= 0 && bi.out_fd >= 0 && bi.buf) {
+#ifdef __linux__
+      bench_run("copy_fd/64M/bare copy_file_range loop", bench_copy_bare, &bi);
+#endif
+      bench_run("copy_fd/64M/cprogress_copy_fd", bench_copy_fd, &bi);
+      bench_run("reader/64M/bare read loop", bench_read_bare, &bi);
+      bench_run("reader/64M/cprogress_reader_read", bench_read_reader, &bi);
+    }
+    if (bi.in_fd >= 0) close(bi.in_fd);
+    if (bi.out_fd >= 0) close(bi.out_fd);
+    free(bi.buf);
+
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int thread_count = 2; thread_count <= 64; thread_count *= 2) {
+      for (int is_shared = 0; is_shared <= 1; ++is_shared) {
+        bench_contended_t bc = { &cprogress, thread_count, is_shared };
+        snprintf(name, sizeof(name), "update/contended/%d threads/%s task", thread_count, is_shared? "shared": "own");
+        bench_run(name, bench_contended, &bc);
+      }
+      if (thread_count >= cpu_count) break;
+    }
+
+    cprogress_destroy(&cprogress);
+  }
+
+  /* everything the renderer prints goes to /dev/null from here on */
+  fflush(stdout);
+  int stdout_fd = dup(STDOUT_FILENO);
+  int null_fd = open("/dev/null", O_WRONLY);
+
+  static const int task_counts[] = { 10, 1000, 100000 };
+  for (size_t i = 0; i < sizeof(task_counts) / sizeof(task_counts[0]); ++i) {
+    cprogress_t cprogress = cprogress_create("$=t [$40b#] $p%", task_counts[i]);
+    cprogress_setframebudget(&cprogress, 0); /* measure full frames only */
+    cprogress_startalltasks(&cprogress);
+    for (int j = 0; j < task_counts[i]; ++j) {
+      cprogress_updatetask_title(&cprogress, j, "Simple task");
+      cprogress_updatetask_percentage(&cprogress, j, (float) (j % 100));
+    }
+
+    snprintf(name, sizeof(name), "render/%d tasks", task_counts[i]);
+    dup2(null_fd, STDOUT_FILENO);
+    bench_run(name, bench_render, &cprogress);
+    snprintf(name, sizeof(name), "render/%d tasks/clean", task_counts[i]);
+    bench_run(name, bench_render_clean, &cprogress);
+    cprogress.detail_level = CPROGRESS_DETAIL_COLLAPSED;
+    snprintf(name, sizeof(name), "render/%d tasks/collapsed", task_counts[i]);
+    bench_run(name, bench_render, &cprogress);
+    cprogress.detail_level = CPROGRESS_DETAIL_FULL;
+
+    /* the 20 most interesting out of all of them */
+    static const char *policy_names[] = { "index", "lowest progress", "lowest rate", "stalest" };
+    for (int policy = CPROGRESS_DISPLAY_INDEX; policy < CPROGRESS_DISPLAY_LENGTH; ++policy) {
+      cprogress_setdisplay(&cprogress, (cprogress_displaypolicy_t) policy, 20);
+      snprintf(name, sizeof(name), "render/%d tasks/top 20 %s", task_counts[i], policy_names[policy]);
+      bench_run(name, bench_render, &cprogress);
+    }
+    fflush(stdout);
+    dup2(stdout_fd, STDOUT_FILENO);
+
+    cprogress_destroy(&cprogress);
+  }
+
+  close(null_fd);
+  close(stdout_fd);
+  fclose(bench_out);
+
+  return 0;
+}
@@ -0,0 +1,64 @@
+/* cprogress::track against the bare loop, linked into cprogress_bench */
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "../cprogress.hpp"
+
+
+/* a chunk of a buffer, what a loop over part of a container looks like */
+struct bench_span {
+  const uint32_t *first;
+  const uint32_t *last;
+  const uint32_t *begin() const { return first; }
+  const uint32_t *end() const { return last; }
+};
+
+struct bench_track_t {
+  cprogress_t *cprogress;
+  std::vector<uint32_t> items;
+};
+
+static volatile uint64_t bench_track_sink;
+
+extern "C" void *bench_track_create(cprogress_t *cprogress, size_t length) {
+  bench_track_t *bt = new bench_track_t { cprogress, std::vector<uint32_t>(length) };
+  for (size_t i = 0; i < length; ++i) bt->items[i] = (uint32_t) rand();
+  return bt;
+}
+
+extern "C" void bench_track_destroy(void *ctx) {
+  delete (bench_track_t *) ctx;
+}
+
+/* [iterations] elements in all, a whole pass over the buffer at a time */
+template <typename Loop>
+static void bench_track_passes(bench_track_t *bt, long iterations, Loop loop) {
+  uint64_t sum = 0;
+  for (long left = iterations; left > 0; ) {
+    size_t length = (size_t) left < bt->items.size()? (size_t) left: bt->items.size();
+    sum += loop(bench_span { bt->items.data(), bt->items.data() + length });
+    left -= (long) length;
+  }
+  bench_track_sink = sum;
+}
+
+extern "C" void bench_track_bare(void *ctx, long iterations) {
+  bench_track_t *bt = (bench_track_t *) ctx;
+  bench_track_passes(bt, iterations, [](bench_span span) {
+    uint64_t sum = 0;
+    for (uint32_t item : span) sum += item;
+    return sum;
+  });
+}
+
+extern "C" void bench_track_tracked(void *ctx, long iterations) {
+  bench_track_t *bt = (bench_track_t *) ctx;
+  bench_track_passes(bt, iterations, [bt](bench_span span) {
+    cprogress_starttask(bt->cprogress, 0);
+    uint64_t sum = 0;
+    for (uint32_t item : cprogress::track(bt->cprogress, 0, span)) sum += item;
+    return sum;
+  });
+}
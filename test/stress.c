@@ -0,0 +1,1073 @@
+#include "stdio.h"
+#include "stdint.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+#include "unistd.h"
+#include "fcntl.h"
+#include "pthread.h"
+#include "poll.h"
+#include "sched.h"
+#include "sys/wait.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+
+/* to run out of memory on demand */
+static int stress_malloc_isfailing;
+#define CPROGRESS_MALLOC(size) (stress_malloc_isfailing? NULL: malloc(size))
+
+#define CPROGRESS_IMPL
+#include "../cprogress.h"
+
+
+/*
+  cprogress_stress [-t MAX_THREADS] [-d SECONDS] [-n TASKS]
+
+  For 1, 2, 4, ... MAX_THREADS updaters, hammer the data providers and task
+  controllers while this thread renders frames into /dev/null as fast as it
+  can, then report update throughput, update latency and frame time.
+  Only the 16 slowest tasks are drawn.
+  A few operations acquire, drive and release a task by handle instead.
+  Task events are deferred and delivered to two subscribers each, which
+  must agree on how many they saw, and every start but those still running
+  must have been matched by exactly one stop. A queue too short for them
+  must only lose events, never deliver them on a worker, and one the
+  render thread fills up itself must not hang it, nor must a full log. Sharing under a
+  name a live job holds must fail and leave its region alone, while one
+  left behind by a dead job is taken over. A task slot whose page can't be
+  allocated is handed out once it can, and acquired tasks are found by
+  index like the fixed ones. An update that moves a cell of
+  any bar must mark a frame, and no more frames are marked than cells of a
+  bar as wide as the lcm of them. A frame drawing fewer rows than the last
+  one erases what is left of it. Displaying some of the rows picks those
+  with the lowest keys. Custom conversions are cut to their width. Task
+  history comes out in order and starts over on a restart or resize. Styles
+  only send what changes.
+  Built with CPROGRESS_CONFIG_STATS, as cprogress_stress_stats, it also
+  checks the counters after a known workload.
+  Build with -DCPROGRESS_ENABLE_TSAN=ON to run it under ThreadSanitizer.
+*/
+
+
+/* histogram
+  log-linear buckets: values below 2^STRESS_HIST_SUBBITS are exact, above
+  that every power of two is split into 2^STRESS_HIST_SUBBITS buckets, so a
+  percentile is within ~3% of the truth */
+
+#define STRESS_HIST_SUBBITS 5
+#define STRESS_HIST_SUBCOUNT (1 << STRESS_HIST_SUBBITS)
+#define STRESS_HIST_LENGTH ((64 - STRESS_HIST_SUBBITS + 1) * STRESS_HIST_SUBCOUNT)
+
+typedef struct {
+  uint64_t counts[STRESS_HIST_LENGTH];
+  uint64_t total;
+} stress_histogram_t;
+
+size_t stress_histogram_bucket(uint64_t value) {
+  if (value < STRESS_HIST_SUBCOUNT) return value;
+  int exponent = 63 - __builtin_clzll(value);
+  int shift = exponent - STRESS_HIST_SUBBITS;
+  return (size_t) (shift + 1) * STRESS_HIST_SUBCOUNT + ((value >> shift) & (STRESS_HIST_SUBCOUNT - 1));
+}
+
+uint64_t stress_histogram_bucketvalue(size_t bucket) {
+  if (bucket < STRESS_HIST_SUBCOUNT) return bucket;
+  int shift = (int) (bucket / STRESS_HIST_SUBCOUNT) - 1;
+  return ((uint64_t) (STRESS_HIST_SUBCOUNT + bucket % STRESS_HIST_SUBCOUNT)) << shift;
+}
+
+void stress_histogram_record(stress_histogram_t *histogram, uint64_t value) {
+  ++histogram->counts[stress_histogram_bucket(value)];
+  ++histogram->total;
+}
+
+void stress_histogram_merge(stress_histogram_t *dest, const stress_histogram_t *src) {
+  for (size_t i = 0; i < STRESS_HIST_LENGTH; ++i)
+    dest->counts[i] += src->counts[i];
+  dest->total += src->total;
+}
+
+uint64_t stress_histogram_percentile(const stress_histogram_t *histogram, double percentile) {
+  uint64_t rank = (uint64_t) (histogram->total * percentile / 100.0);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < STRESS_HIST_LENGTH; ++i) {
+    seen += histogram->counts[i];
+    if (seen > rank) return stress_histogram_bucketvalue(i);
+  }
+  return 0;
+}
+
+
+/* event subscribers */
+
+static uint64_t stress_event_counts[2];
+static int64_t stress_started_count; /* starts - stops */
+
+/* C code spelling out the struct tag has to keep building */
+void stress_onevent_first(struct cprogress *cprogress, int task_index) {
+  __atomic_add_fetch(&stress_event_counts[0], 1, __ATOMIC_RELAXED);
+}
+
+void stress_onstart(cprogress_t *cprogress, int task_index) {
+  __atomic_add_fetch(&stress_started_count, 1, __ATOMIC_RELAXED);
+}
+
+void stress_onstop(cprogress_t *cprogress, int task_index) {
+  __atomic_sub_fetch(&stress_started_count, 1, __ATOMIC_RELAXED);
+}
+
+void stress_onevent_second(cprogress_t *cprogress, int task_index) {
+  __atomic_add_fetch(&stress_event_counts[1], 1, __ATOMIC_RELAXED);
+}
+
+
+/* updaters */
+
+typedef struct {
+  cprogress_t *cprogress;
+  int task_count;
+  int *is_stopping;
+  int *stopped_count;
+  pthread_barrier_t *barrier;
+
+  uint64_t seed;
+  uint64_t operation_count;
+  stress_histogram_t latency;
+} stress_updater_t;
+
+int64_t stress_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+uint64_t stress_random(uint64_t *state) {
+  /* xorshift64 */
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+void *stress_updater(void *userdata) {
+  stress_updater_t *updater = (stress_updater_t *) userdata;
+  cprogress_t *cprogress = updater->cprogress;
+  static const char *titles[] = { "Downloading", "Extracting", "Compiling a rather long title" };
+
+  pthread_barrier_wait(updater->barrier);
+
+  while (!__atomic_load_n(updater->is_stopping, __ATOMIC_RELAXED)) {
+    /* batch between checks, so the flag stays off the hot path */
+    for (int i = 0; i < 256; ++i) {
+      uint64_t random = stress_random(&updater->seed);
+      int task_index = (int) (random % updater->task_count);
+      int dice = (int) ((random >> 32) % 1000);
+
+      int64_t begin = stress_now();
+      if (dice < 900) {
+        cprogress_updatetask_percentage(cprogress, task_index, (float) ((random >> 16) % 10500) / 100);
+      } else if (dice < 960) {
+        cprogress_updatetask_title(cprogress, task_index, titles[(random >> 8) % 3]);
+      } else if (dice < 990) {
+        cprogress_starttask(cprogress, task_index);
+      } else if (dice < 995) {
+        cprogress_aborttask(cprogress, task_index);
+      } else if (dice < 998) {
+        cprogress_taskhandle_t task = cprogress_task_acquire(cprogress);
+        cprogress_task_start(task);
+        cprogress_task_updatetitle(task, titles[(random >> 8) % 3]);
+        cprogress_task_updatepercentage(task, (float) ((random >> 16) % 10000) / 100);
+        cprogress_task_release(task);
+        /* stale from here on */
+        cprogress_task_updatepercentage(task, 50);
+      } else {
+        cprogress_log(cprogress, "task %d says hi", task_index);
+      }
+      stress_histogram_record(&updater->latency, (uint64_t) (stress_now() - begin));
+    }
+    updater->operation_count += 256;
+  }
+
+  __atomic_add_fetch(updater->stopped_count, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+
+void stress_run(int thread_count, int task_count, double duration) {
+  cprogress_t cprogress = cprogress_create("$=t [$40b#] $p%", task_count);
+  if (cprogress.error) {
+    fprintf(stderr, "failed to create instance, error %d\n", cprogress.error);
+    exit(1);
+  }
+
+  cprogress_deferevents(&cprogress, 1024, CPROGRESS_EVENTS_BLOCK);
+  cprogress_openlog(&cprogress, 1024, CPROGRESS_LOG_DROP);
+  cprogress_setdisplay(&cprogress, CPROGRESS_DISPLAY_LOWESTRATE, 16);
+  int has_tick = cprogress_tick_open(&cprogress) == CPROGRESS_ERROR_OK;
+  for (int type = CPROGRESS_EVENT_THREADSTART; type <= CPROGRESS_EVENT_THREADSTOP; ++type) {
+    cprogress_subscribeevent(&cprogress, (cprogress_event_type_t) type, stress_onevent_first);
+    cprogress_subscribeevent(&cprogress, (cprogress_event_type_t) type, stress_onevent_second);
+  }
+  cprogress_subscribeevent(&cprogress, CPROGRESS_EVENT_THREADSTART, stress_onstart);
+  cprogress_subscribeevent(&cprogress, CPROGRESS_EVENT_THREADSTOP, stress_onstop);
+  stress_event_counts[0] = stress_event_counts[1] = 0;
+  stress_started_count = 0;
+  cprogress_startalltasks(&cprogress);
+
+  int is_stopping = 0, stopped_count = 0;
+  pthread_barrier_t barrier;
+  pthread_barrier_init(&barrier, NULL, thread_count + 1);
+
+  pthread_t *threads = (pthread_t *) calloc(thread_count, sizeof(pthread_t));
+  stress_updater_t *updaters = (stress_updater_t *) calloc(thread_count, sizeof(stress_updater_t));
+  for (int i = 0; i < thread_count; ++i) {
+    updaters[i] = (stress_updater_t) {
+      .cprogress = &cprogress,
+      .task_count = task_count,
+      .is_stopping = &is_stopping,
+      .stopped_count = &stopped_count,
+      .barrier = &barrier,
+      .seed = 0x9e3779b97f4a7c15ULL * (i + 1),
+    };
+    pthread_create(&threads[i], NULL, stress_updater, &updaters[i]);
+  }
+
+  stress_histogram_t *frame_time = (stress_histogram_t *) calloc(1, sizeof(stress_histogram_t));
+
+  pthread_barrier_wait(&barrier);
+  int64_t begin = stress_now();
+  int64_t deadline = begin + (int64_t) (duration * 1e9);
+  int64_t now = begin;
+  for (int frame_count = 0; now < deadline; ++frame_count) {
+    /* go through what a slow terminal would get, see SLOW TERMINALS */
+    cprogress.detail_level = (cprogress_detail_t) (frame_count / 256 % (CPROGRESS_DETAIL_MINIMAL + 1));
+    if (has_tick && frame_count % 64 == 0) {
+      /* as an event loop would, updaters wake it */
+      struct pollfd fd = { .fd = cprogress.tick->epoll_fd, .events = POLLIN };
+      if (poll(&fd, 1, 100) != 1) {
+        fprintf(stderr, "tick fd not readable while tasks are updated\n");
+        exit(1);
+      }
+      cprogress_tick(&cprogress, 1000);
+    } else {
+      cprogress_beginrender_consolewidth(&cprogress, 80);
+      cprogress_render(&cprogress);
+      cprogress_endrender(&cprogress);
+    }
+    int64_t frame_end = stress_now();
+    stress_histogram_record(frame_time, (uint64_t) (frame_end - now));
+    now = frame_end;
+  }
+  __atomic_store_n(&is_stopping, 1, __ATOMIC_RELAXED);
+  /* some may wait for room in the queue */
+  while (__atomic_load_n(&stopped_count, __ATOMIC_ACQUIRE) < thread_count) {
+    cprogress_flushevents(&cprogress);
+    sched_yield();
+  }
+
+  stress_histogram_t *latency = (stress_histogram_t *) calloc(1, sizeof(stress_histogram_t));
+  uint64_t operation_count = 0;
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_join(threads[i], NULL);
+    stress_histogram_merge(latency, &updaters[i].latency);
+    operation_count += updaters[i].operation_count;
+  }
+  double elapsed = (stress_now() - begin) / 1e9;
+
+  cprogress_flushevents(&cprogress);
+  if (stress_event_counts[0] != stress_event_counts[1]) {
+    fprintf(stderr, "subscribers disagree: %llu vs %llu events\n",
+      (unsigned long long) stress_event_counts[0], (unsigned long long) stress_event_counts[1]);
+    exit(1);
+  }
+
+  int64_t alive_count = 0;
+  cprogress_taskinfo_foreach(&cprogress, taskinfo)
+    alive_count += cprogress_taskinfo_isrunning(taskinfo);
+  if (stress_started_count != alive_count) {
+    fprintf(stderr, "%lld tasks running, but %lld more starts than stops\n",
+      (long long) alive_count, (long long) stress_started_count);
+    exit(1);
+  }
+
+  fprintf(stderr, "%7d %12.2f %8llu %8llu %8llu %8llu %10llu %10llu %10llu %10llu\n",
+    thread_count, operation_count / elapsed / 1e6,
+    (unsigned long long) stress_histogram_percentile(latency, 50),
+    (unsigned long long) stress_histogram_percentile(latency, 99),
+    (unsigned long long) stress_histogram_percentile(latency, 99.9),
+    (unsigned long long) frame_time->total,
+    (unsigned long long) stress_histogram_percentile(frame_time, 50) / 1000,
+    (unsigned long long) stress_histogram_percentile(frame_time, 99) / 1000,
+    (unsigned long long) stress_histogram_percentile(frame_time, 99.9) / 1000,
+    (unsigned long long) stress_event_counts[0]);
+
+  pthread_barrier_destroy(&barrier);
+  free(latency);
+  free(frame_time);
+  free(updaters);
+  free(threads);
+  cprogress_destroy(&cprogress);
+}
+
+
+/* a queue too short for the events, dropped ones are counted and the rest
+  only ever reach the render thread */
+
+#define STRESS_OVERFLOW_CYCLES 20000
+
+static pthread_t stress_overflow_renderer;
+static uint64_t stress_overflow_delivered_count;
+static int stress_overflow_is_misdelivered;
+
+void stress_overflow_onevent(cprogress_t *cprogress, int task_index) {
+  if (!pthread_equal(pthread_self(), stress_overflow_renderer))
+    __atomic_store_n(&stress_overflow_is_misdelivered, 1, __ATOMIC_RELAXED);
+  ++stress_overflow_delivered_count;
+}
+
+typedef struct {
+  cprogress_t *cprogress;
+  int task_index;
+  int *stopped_count;
+} stress_overflow_worker_t;
+
+/* one task each, so every start and every abort emits once */
+void *stress_overflow_worker(void *userdata) {
+  stress_overflow_worker_t *worker = (stress_overflow_worker_t *) userdata;
+  for (int i = 0; i < STRESS_OVERFLOW_CYCLES; ++i) {
+    cprogress_starttask(worker->cprogress, worker->task_index);
+    cprogress_aborttask(worker->cprogress, worker->task_index);
+  }
+  __atomic_add_fetch(worker->stopped_count, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+void stress_overflow(int thread_count) {
+  cprogress_t cprogress = cprogress_create("$=t [$40b#] $p%", thread_count);
+  cprogress_deferevents(&cprogress, 4, CPROGRESS_EVENTS_DROP);
+  cprogress_subscribeevent(&cprogress, CPROGRESS_EVENT_THREADSTART, stress_overflow_onevent);
+  cprogress_subscribeevent(&cprogress, CPROGRESS_EVENT_THREADSTOP, stress_overflow_onevent);
+  stress_overflow_renderer = pthread_self();
+  stress_overflow_delivered_count = 0;
+
+  int stopped_count = 0;
+  pthread_t *threads = (pthread_t *) calloc(thread_count, sizeof(pthread_t));
+  stress_overflow_worker_t *workers = (stress_overflow_worker_t *) calloc(thread_count, sizeof(stress_overflow_worker_t));
+  for (int i = 0; i < thread_count; ++i) {
+    workers[i] = (stress_overflow_worker_t) { &cprogress, i, &stopped_count };
+    pthread_create(&threads[i], NULL, stress_overflow_worker, &workers[i]);
+  }
+
+  while (__atomic_load_n(&stopped_count, __ATOMIC_ACQUIRE) < thread_count) {
+    cprogress_beginrender_consolewidth(&cprogress, 80);
+    cprogress_render(&cprogress);
+    cprogress_endrender(&cprogress);
+  }
+  for (int i = 0; i < thread_count; ++i)
+    pthread_join(threads[i], NULL);
+  cprogress_flushevents(&cprogress);
+
+  uint64_t emitted_count = 2ULL * STRESS_OVERFLOW_CYCLES * thread_count;
+  uint64_t dropped_count = cprogress.events_dropped_count;
+  if (stress_overflow_is_misdelivered || stress_overflow_delivered_count + dropped_count != emitted_count) {
+    fprintf(stderr, "overflowing events: %llu delivered, %llu dropped of %llu, %s\n",
+      (unsigned long long) stress_overflow_delivered_count, (unsigned long long) dropped_count,
+      (unsigned long long) emitted_count, stress_overflow_is_misdelivered? "some on a worker": "all on the renderer");
+    exit(1);
+  }
+
+  free(workers);
+  free(threads);
+  cprogress_destroy(&cprogress);
+}
+
+/* the render thread filling a blocking queue has to empty it itself */
+void stress_overflow_self() {
+  cprogress_t cprogress = cprogress_create("$=t [$40b#] $p%", 300);
+  cprogress_deferevents(&cprogress, 256, CPROGRESS_EVENTS_BLOCK);
+  cprogress_subscribeevent(&cprogress, CPROGRESS_EVENT_THREADSTART, stress_overflow_onevent);
+  stress_overflow_renderer = pthread_self();
+  stress_overflow_delivered_count = 0;
+
+  cprogress_startalltasks(&cprogress);
+  cprogress_flushevents(&cprogress);
+  if (stress_overflow_is_misdelivered || stress_overflow_delivered_count != 300 || cprogress.events_dropped_count) {
+    fprintf(stderr, "starting 300 tasks on the renderer: %llu delivered, %llu dropped\n",
+      (unsigned long long) stress_overflow_delivered_count, (unsigned long long) cprogress.events_dropped_count);
+    exit(1);
+  }
+  cprogress_destroy(&cprogress);
+}
+
+
+/* the render thread logging into a full blocking queue writes it out
+  itself, or drops the line in the middle of a frame */
+
+size_t stress_log_conversion(char *buf, size_t buf_len, size_t alloc_width,
+  cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo, void *userdata) {
+  for (int i = 0; i < 8; ++i) cprogress_log(cprogress, "logged while drawing");
+  return 0;
+}
+
+void stress_log_self() {
+  cprogress_registerconversion('L', stress_log_conversion, NULL, CPROGRESS_CONVERSION_FIXEDWIDTH, 1);
+  cprogress_t cprogress = cprogress_create("$=t $L $p%", 1);
+  cprogress_openlog(&cprogress, 4, CPROGRESS_LOG_BLOCK);
+  cprogress_starttask(&cprogress, 0);
+
+  for (int i = 0; i < 100; ++i) cprogress_log(&cprogress, "line %d", i);
+  uint64_t dropped_count = cprogress.log_dropped_count;
+  cprogress_beginrender_consolewidth(&cprogress, 80);
+  cprogress_render(&cprogress);
+  cprogress_endrender(&cprogress);
+  if (dropped_count || !cprogress.log_dropped_count) {
+    fprintf(stderr, "logging on the renderer: %llu lines dropped between frames, %llu while drawing\n",
+      (unsigned long long) dropped_count, (unsigned long long) (cprogress.log_dropped_count - dropped_count));
+    exit(1);
+  }
+
+  cprogress_destroy(&cprogress);
+  cprogress_registerconversion('L', NULL, NULL, CPROGRESS_CONVERSION_FIXEDWIDTH, 1);
+}
+
+
+/* every item visited once, whoever ends up with its chunk */
+
+void stress_parallel_visit(long begin, long end, int worker_index, void *ctx) {
+  unsigned char *visits = (unsigned char *) ctx;
+  for (long i = begin; i < end; ++i) ++visits[i];
+}
+
+void stress_parallel(int thread_count) {
+  cprogress_t cprogress = cprogress_create("$=t [$40b#] $p%", 0);
+  cprogress_setparallel(&cprogress, thread_count * 2, CPROGRESS_PARALLEL_WORKERROWS);
+
+  static const long grains[] = { 0, 1, 7, 4096 };
+  long length = 1 << 20;
+  unsigned char *visits = (unsigned char *) calloc(length, 1);
+  for (size_t i = 0; i < sizeof(grains) / sizeof(grains[0]); ++i) {
+    memset(visits, 0, length);
+    cprogress_parallel_for(&cprogress, 0, length, grains[i], stress_parallel_visit, visits);
+    for (long j = 0; j < length; ++j) {
+      if (visits[j] != 1) {
+        fprintf(stderr, "parallel_for with grain %ld visited item %ld %d times\n", grains[i], j, visits[j]);
+        exit(1);
+      }
+    }
+  }
+
+  free(visits);
+  cprogress_destroy(&cprogress);
+}
+
+/* worker 0 stuck in a chunk, the others report meanwhile */
+
+typedef struct {
+  cprogress_t *cprogress;
+  int is_stuck;
+  int is_reported;
+} stress_parallel_stuck_t;
+
+void stress_parallel_stuck(long begin, long end, int worker_index, void *ctx) {
+  stress_parallel_stuck_t *stuck = (stress_parallel_stuck_t *) ctx;
+  /* or they'd have taken all of its chunks before it gets one */
+  if (worker_index) {
+    while (!__atomic_load_n(&stuck->is_stuck, __ATOMIC_ACQUIRE)) sched_yield();
+    return;
+  }
+  if (stuck->is_stuck) return;
+  __atomic_store_n(&stuck->is_stuck, 1, __ATOMIC_RELEASE);
+
+  for (int64_t deadline = stress_now() + 2000000000LL; stress_now() < deadline; usleep(1000)) {
+    cprogress_taskinfo_foreach(stuck->cprogress, taskinfo) {
+      if (cprogress_taskinfo_isrunning(taskinfo) && cprogress_taskinfo_getpercentage(taskinfo) > 0) {
+        stuck->is_reported = 1;
+        return;
+      }
+    }
+  }
+}
+
+void stress_parallel_report(int thread_count) {
+  cprogress_t cprogress = cprogress_create("$=t [$40b#] $p%", 0);
+  cprogress_setparallel(&cprogress, thread_count + 1, CPROGRESS_PARALLEL_NORENDER);
+
+  stress_parallel_stuck_t stuck = { &cprogress, 0, 0 };
+  cprogress_parallel_for(&cprogress, 0, 1 << 16, 16, stress_parallel_stuck, &stuck);
+  if (!stuck.is_reported) {
+    fprintf(stderr, "parallel_for reported nothing while worker 0 was busy\n");
+    exit(1);
+  }
+  cprogress_destroy(&cprogress);
+}
+
+
+/* the same bytes out, whichever way the kernel takes them */
+
+#define STRESS_IO_LENGTH ((20 << 20) + 123) /* a few chunks, not a whole one */
+
+typedef struct {
+  int fd;
+  const char *data;
+} stress_io_writer_t;
+
+void *stress_io_writer(void *userdata) {
+  stress_io_writer_t *writer = (stress_io_writer_t *) userdata;
+  for (long written = 0; written < STRESS_IO_LENGTH;) {
+    ssize_t length = write(writer->fd, writer->data + written, STRESS_IO_LENGTH - written);
+    if (length <= 0) break;
+    written += length;
+  }
+  close(writer->fd);
+  return NULL;
+}
+
+int stress_io_tempfile() {
+  char path[] = "/tmp/cprogress-stress-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd >= 0) unlink(path);
+  return fd;
+}
+
+void stress_io_check(cprogress_t *cprogress, const char *name, int fd, const char *data, long length) {
+  cprogress_reader_t reader;
+  char *buf = (char *) malloc(length + 1);
+  lseek(fd, 0, SEEK_SET);
+  cprogress_updatetask_percentage(cprogress, 1, 0);
+  cprogress_reader_open(&reader, cprogress, 1, fd);
+
+  long read_length = 0;
+  for (int64_t n; (n = cprogress_reader_read(&reader, buf + read_length, 4096 + 7)) > 0;) read_length += n;
+  if (read_length != length || memcmp(buf, data, length) ||
+    cprogress_gettaskinfo(cprogress, 0).percentage != 100 || cprogress_gettaskinfo(cprogress, 1).percentage != 100) {
+    fprintf(stderr, "%s: %ld bytes of %ld came out, or not at 100%%\n", name, read_length, length);
+    exit(1);
+  }
+  free(buf);
+}
+
+void stress_io() {
+  cprogress_t cprogress = cprogress_create("$=t [$40b#] $p%", 2);
+  cprogress_startalltasks(&cprogress);
+
+  char *data = (char *) malloc(STRESS_IO_LENGTH);
+  for (long i = 0; i < STRESS_IO_LENGTH; ++i) data[i] = (char) (i * 7 + i / 4099);
+  int in_fd = stress_io_tempfile();
+  for (long written = 0; written < STRESS_IO_LENGTH;)
+    written += write(in_fd, data + written, STRESS_IO_LENGTH - written);
+
+  /* file to file, all of it, then a part not on a page boundary */
+  static const long lengths[] = { -1, STRESS_IO_LENGTH / 3 + 5 };
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i) {
+    int out_fd = stress_io_tempfile();
+    lseek(in_fd, 0, SEEK_SET);
+    cprogress_updatetask_percentage(&cprogress, 0, 0);
+    int64_t copied = cprogress_copy_fd(&cprogress, 0, in_fd, out_fd, lengths[i]);
+    long length = lengths[i] < 0? STRESS_IO_LENGTH: lengths[i];
+    if (copied != length) {
+      fprintf(stderr, "copy_fd copied %lld bytes of %ld\n", (long long) copied, length);
+      exit(1);
+    }
+    stress_io_check(&cprogress, "copy_fd from a file", out_fd, data, length);
+    close(out_fd);
+  }
+
+  /* from a pipe, till it's closed */
+  int pipe_fds[2];
+  pthread_t thread;
+  if (!pipe(pipe_fds)) {
+    int out_fd = stress_io_tempfile();
+    stress_io_writer_t writer = { pipe_fds[1], data };
+    pthread_create(&thread, NULL, stress_io_writer, &writer);
+    cprogress_updatetask_percentage(&cprogress, 0, 0);
+    int64_t counted = 0;
+    cprogress_copy_fdcounted(&cprogress, 0, pipe_fds[0], out_fd, -1, &counted);
+    pthread_join(thread, NULL);
+    stress_io_check(&cprogress, "copy_fd from a pipe", out_fd, data, STRESS_IO_LENGTH);
+    if (counted != STRESS_IO_LENGTH) {
+      fprintf(stderr, "copy_fdcounted counted %lld bytes of %ld\n", (long long) counted, (long) STRESS_IO_LENGTH);
+      exit(1);
+    }
+    close(pipe_fds[0]);
+    close(out_fd);
+  }
+
+  /* sized 0, and nothing to copy_file_range(2) */
+  int proc_fd = open("/proc/version", O_RDONLY);
+  if (proc_fd >= 0) {
+    char expected[4096];
+    ssize_t expected_length = read(proc_fd, expected, sizeof(expected));
+    lseek(proc_fd, 0, SEEK_SET);
+    int out_fd = stress_io_tempfile();
+    cprogress_updatetask_percentage(&cprogress, 0, 0);
+    int64_t copied = cprogress_copy_fd(&cprogress, 0, proc_fd, out_fd, -1);
+    if (expected_length <= 0 || copied != expected_length) {
+      fprintf(stderr, "copy_fd copied %lld bytes of /proc/version, %lld expected\n",
+        (long long) copied, (long long) expected_length);
+      exit(1);
+    }
+    stress_io_check(&cprogress, "copy_fd from /proc", out_fd, expected, (long) expected_length);
+    close(out_fd);
+    close(proc_fd);
+  }
+
+  close(in_fd);
+  free(data);
+  cprogress_destroy(&cprogress);
+}
+
+
+/* one frame as written to the terminal, NUL terminated */
+size_t stress_captureframe(cprogress_t *cprogress, char *buf, size_t buf_len) {
+  int capture_fd = stress_io_tempfile();
+  int stdout_fd = dup(STDOUT_FILENO);
+  fflush(stdout);
+  dup2(capture_fd, STDOUT_FILENO);
+
+  __atomic_store_n(&cprogress->is_dirty, 1, __ATOMIC_RELAXED);
+  cprogress_beginrender_consolewidth(cprogress, 80);
+  cprogress_render(cprogress);
+  cprogress_endrender(cprogress);
+
+  fflush(stdout);
+  dup2(stdout_fd, STDOUT_FILENO);
+  close(stdout_fd);
+  ssize_t length = pread(capture_fd, buf, buf_len - 1, 0);
+  close(capture_fd);
+  buf[length > 0? length: 0] = 0;
+  return length > 0? (size_t) length: 0;
+}
+
+/* going from 5 rows down to the summary line erases the other 4 before
+  moving back up over the one left */
+void stress_collapse() {
+  cprogress_t cprogress = cprogress_create("$=t [$20b#] $p%", 5);
+  cprogress_startalltasks(&cprogress);
+  char frame[4096];
+  stress_captureframe(&cprogress, frame, sizeof(frame));
+
+  cprogress.detail_level = CPROGRESS_DETAIL_COLLAPSED;
+  stress_captureframe(&cprogress, frame, sizeof(frame));
+  const char *erase = strstr(frame, "\n\x1b[J");
+  if (!erase || !strstr(erase, "\x1b[A")) {
+    fprintf(stderr, "collapsing to one line left the other rows on screen\n");
+    exit(1);
+  }
+  cprogress_destroy(&cprogress);
+}
+
+
+/* the rows chosen are the ones with the lowest keys, ties going to the
+  lower index, and fewer of them than drawn last erase the rest */
+void stress_display() {
+  cprogress_t cprogress = cprogress_create("$=t [$20b#] $p%", 20);
+  cprogress_startalltasks(&cprogress);
+  for (int i = 0; i < 20; ++i)
+    cprogress_updatetask_percentage(&cprogress, i, (float) ((i * 7) % 10 * 10));
+  char frame[8192];
+  stress_captureframe(&cprogress, frame, sizeof(frame));
+
+  cprogress_setdisplay(&cprogress, CPROGRESS_DISPLAY_LOWESTPROGRESS, 4);
+  stress_captureframe(&cprogress, frame, sizeof(frame));
+  const char *erase = strstr(frame, "\n\x1b[J");
+  if (!erase || !strstr(erase, "\x1b[4A")) {
+    fprintf(stderr, "displaying 4 rows out of 20 left the others on screen\n");
+    exit(1);
+  }
+
+  /* 0% for 0 and 10, then 10% for 3 and 13 */
+  for (int i = 0; i < 20; ++i) {
+    int is_chosen = cprogress_gettaskinfo(&cprogress, i).display_mark == cprogress.display_mark;
+    if (is_chosen != (i == 0 || i == 10 || i == 3 || i == 13)) {
+      fprintf(stderr, "task %d at %.0f%% was %s\n", i, cprogress_gettaskinfo(&cprogress, i).percentage,
+        is_chosen? "chosen": "left out");
+      exit(1);
+    }
+  }
+
+  /* ties to the lower index */
+  cprogress_setdisplay(&cprogress, CPROGRESS_DISPLAY_LOWESTPROGRESS, 3);
+  stress_captureframe(&cprogress, frame, sizeof(frame));
+  if (cprogress_gettaskinfo(&cprogress, 13).display_mark == cprogress.display_mark ||
+    cprogress_gettaskinfo(&cprogress, 3).display_mark != cprogress.display_mark) {
+    fprintf(stderr, "a tie went to the higher index\n");
+    exit(1);
+  }
+  cprogress_destroy(&cprogress);
+}
+
+
+/* conversions writing past their columns are cut there, utf-8 aware, and
+  asked once per line */
+
+static int stress_conversion_calls[2];
+
+size_t stress_conversion_toolong(char *buf, size_t buf_len, size_t alloc_width,
+  cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo, void *userdata) {
+  ++stress_conversion_calls[0];
+  size_t length = 0;
+  while (length < buf_len && length < 60) buf[length++] = 'x';
+  return length;
+}
+
+size_t stress_conversion_toowide(char *buf, size_t buf_len, size_t alloc_width,
+  cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo, void *userdata) {
+  ++stress_conversion_calls[1];
+  size_t length = 0;
+  while (length + 2 <= buf_len && length < 40) {
+    buf[length++] = (char) 0xc3;
+    buf[length++] = (char) 0xa9; /* é */
+  }
+  return length;
+}
+
+void stress_conversion() {
+  cprogress_registerconversion('X', stress_conversion_toolong, NULL, CPROGRESS_CONVERSION_MAXWIDTH, 5);
+  cprogress_registerconversion('Y', stress_conversion_toowide, NULL, CPROGRESS_CONVERSION_FIXEDWIDTH, 4);
+  cprogress_t cprogress = cprogress_create("[$X|$Y] $p%", 1);
+  cprogress_starttask(&cprogress, 0);
+
+  char line[1024];
+  for (int i = 1; i <= 3; ++i) {
+    memset(line, 0, sizeof(line));
+    cprogress_writeline(&cprogress, line, sizeof(line) - 1, 80, "", 50);
+    if (strncmp(line, "[xxxxx|\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9] ", 17) ||
+      stress_conversion_calls[0] != i || stress_conversion_calls[1] != i) {
+      fprintf(stderr, "conversions drew \"%s\", asked %d and %d times for %d lines\n",
+        line, stress_conversion_calls[0], stress_conversion_calls[1], i);
+      exit(1);
+    }
+  }
+
+  cprogress_destroy(&cprogress);
+  cprogress_registerconversion('X', NULL, NULL, CPROGRESS_CONVERSION_MAXWIDTH, 5);
+  cprogress_registerconversion('Y', NULL, NULL, CPROGRESS_CONVERSION_FIXEDWIDTH, 4);
+}
+
+
+/* samples come out oldest first, a restart starts them over, so does
+  another length, and $Ns draws the last N scaled to the highest */
+
+void stress_history_check(cprogress_t *cprogress, const char *name, size_t samples_length,
+  const float *expected, size_t expected_length) {
+  float samples[16];
+  int error = cprogress_gettaskhistory(cprogress, 0, samples, &samples_length);
+  int is_same = !error && samples_length == expected_length;
+  for (size_t i = 0; is_same && i < samples_length; ++i)
+    is_same = samples[i] > expected[i] - 0.01f && samples[i] < expected[i] + 0.01f;
+  if (!is_same) {
+    fprintf(stderr, "history %s: %zu samples", name, samples_length);
+    for (size_t i = 0; i < samples_length; ++i) fprintf(stderr, " %.2f", samples[i]);
+    fprintf(stderr, ", %zu expected\n", expected_length);
+    exit(1);
+  }
+}
+
+size_t stress_history_sample(cprogress_t *cprogress, float percentage, char *frame, size_t frame_len) {
+  cprogress_updatetask_percentage(cprogress, 0, percentage);
+  cprogress->history_sample_ns = cprogress_nanotime() - cprogress->history_interval_ns;
+  return stress_captureframe(cprogress, frame, frame_len);
+}
+
+void stress_history() {
+  cprogress_t cprogress = cprogress_create("$=t $6s", 1);
+  cprogress_sethistory(&cprogress, 4, 1000);
+  cprogress_starttask(&cprogress, 0);
+
+  char frame[4096];
+  static const float percentages[] = { 10, 30, 35, 35, 60 };
+  for (size_t i = 0; i < sizeof(percentages) / sizeof(percentages[0]); ++i)
+    stress_history_sample(&cprogress, percentages[i], frame, sizeof(frame));
+  stress_history_check(&cprogress, "wrapped", 16, (const float[]) { 20, 5, 0, 25 }, 4);
+  stress_history_check(&cprogress, "cut", 2, (const float[]) { 0, 25 }, 2);
+  if (!strstr(frame, "  \u2587\u2582 \u2588")) {
+    fprintf(stderr, "history of 20 5 0 25 didn't draw as \"  \u2587\u2582 \u2588\"\n");
+    exit(1);
+  }
+
+  cprogress_aborttask(&cprogress, 0);
+  cprogress_starttask(&cprogress, 0);
+  stress_history_sample(&cprogress, 0, frame, sizeof(frame));
+  stress_history_sample(&cprogress, 10, frame, sizeof(frame));
+  stress_history_check(&cprogress, "restarted", 16, (const float[]) { 0, 10 }, 2);
+
+  cprogress_sethistory(&cprogress, 8, 1000);
+  stress_history_check(&cprogress, "resized", 16, NULL, 0);
+  for (int i = 1; i <= 10; ++i)
+    stress_history_sample(&cprogress, 10 + i, frame, sizeof(frame));
+  stress_history_check(&cprogress, "resized and wrapped", 16, (const float[]) { 1, 1, 1, 1, 1, 1, 1, 1 }, 8);
+
+  cprogress_destroy(&cprogress);
+}
+
+
+/* only what changes between elements is sent, and the line ends unstyled,
+  [style_mask] stands in for the terminal */
+
+void stress_styles_check(const char *fmt, int style_mask, const char *expected) {
+  cprogress_t cprogress = cprogress_create(fmt, 1);
+  cprogress.style_mask = style_mask;
+  char line[512] = {};
+  cprogress_writeline(&cprogress, line, sizeof(line) - 1, 40, "", 50);
+  if (strcmp(line, expected)) {
+    fprintf(stderr, "\"%s\" with styles %#x drew:\n", fmt, style_mask);
+    for (const char *ptr = line; *ptr; ++ptr) fprintf(stderr, *ptr == '\x1b'? "\\e": "%c", *ptr);
+    fprintf(stderr, "\n");
+    exit(1);
+  }
+  cprogress_destroy(&cprogress);
+}
+
+void stress_styles() {
+  int all = CPROGRESS_STYLE_ATTRMASK | CPROGRESS_STYLE_COLORMASK;
+  /* 22 takes both bold and dim, dim comes back, red goes to the default */
+  stress_styles_check("${bold,red}ab${dim}[$10b#]", all, "\x1b[1;31mab\x1b[22;2;39m[#####     ]\x1b[m");
+  stress_styles_check("${bold,dim}ab${dim,italic}cd${italic}ef${}gh", all,
+    "\x1b[1;2mab\x1b[22;2;3mcd\x1b[22mef\x1b[mgh");
+  stress_styles_check("${underline,green}ab${green}cd", all, "\x1b[4;32mab\x1b[24mcd\x1b[m");
+  /* NO_COLOR keeps the rest */
+  stress_styles_check("${bold,red}ab${dim}[$10b#]", CPROGRESS_STYLE_ATTRMASK, "\x1b[1mab\x1b[22;2m[#####     ]\x1b[m");
+  /* not a terminal, as if unstyled */
+  stress_styles_check("${bold,red}ab${dim}[$10b#]", 0, "ab[#####     ]");
+  stress_styles_check("ab[$10b#]", 0, "ab[#####     ]");
+}
+
+
+#ifdef CPROGRESS_CONFIG_STATS
+/* the counters add up to a known workload */
+void stress_stats() {
+  cprogress_t cprogress = cprogress_create("$=t [$20b#] $p%", 2);
+  cprogress_startalltasks(&cprogress);
+  cprogress_taskhandle_t task = cprogress_task_acquire(&cprogress);
+  cprogress_task_start(task);
+
+  for (int i = 1; i <= 10; ++i) {
+    cprogress_updatetask_percentage(&cprogress, 0, (float) i);
+    cprogress_updatetask_addpercentage(&cprogress, 1, 1);
+  }
+  for (int i = 0; i < 3; ++i) cprogress_updatetask_title(&cprogress, 1, "title");
+  cprogress_task_updatepercentage(task, 50);
+  /* not running anymore, not counted */
+  cprogress_aborttask(&cprogress, 0);
+  cprogress_updatetask_percentage(&cprogress, 0, 20);
+
+  char frame[4096];
+  size_t emitted_bytes = stress_captureframe(&cprogress, frame, sizeof(frame));
+  emitted_bytes += stress_captureframe(&cprogress, frame, sizeof(frame));
+
+  cprogress_stats_t stats;
+  cprogress_taskstats_t taskstats[3];
+  int error = cprogress_getstats(&cprogress, &stats);
+  error |= cprogress_gettaskstats(&cprogress, 0, &taskstats[0]);
+  error |= cprogress_gettaskstats(&cprogress, 1, &taskstats[1]);
+  error |= cprogress_gettaskstats(&cprogress, task.index, &taskstats[2]);
+  if (error || stats.update_count != 21 || stats.title_update_count != 3 ||
+    taskstats[0].update_count != 10 || taskstats[1].update_count != 10 || taskstats[1].title_update_count != 3 ||
+    taskstats[2].update_count != 1 || stats.frame_count != 2 || stats.emitted_bytes != emitted_bytes ||
+    stats.write_count < 2 || stats.writeline_count < 2 * 2) {
+    fprintf(stderr, "stats: %llu updates, %llu titles, %llu frames of %llu bytes (%zu written), %llu lines\n",
+      (unsigned long long) stats.update_count, (unsigned long long) stats.title_update_count,
+      (unsigned long long) stats.frame_count, (unsigned long long) stats.emitted_bytes, emitted_bytes,
+      (unsigned long long) stats.writeline_count);
+    exit(1);
+  }
+  cprogress_destroy(&cprogress);
+}
+#endif
+
+
+/* two bars neither a multiple of the other, and no digits */
+void stress_visible() {
+  static const int widths[] = { 10, 7 };
+  cprogress_t cprogress = cprogress_create("$10b# $7b=", 1);
+  cprogress_starttask(&cprogress, 0);
+  cprogress_beginrender_consolewidth(&cprogress, 80);
+  cprogress_render(&cprogress);
+  cprogress_endrender(&cprogress);
+
+  int cells[2] = { 0, 0 };
+  int frame_count = 0;
+  for (int i = 1; i <= 10000; ++i) {
+    float percentage = i / 100.0f;
+    cprogress_updatetask_percentage(&cprogress, 0, percentage);
+
+    int is_visible = 0;
+    for (int j = 0; j < 2; ++j) {
+      int bar_cells = (int) (widths[j] * (percentage / 100.0));
+      if (bar_cells != cells[j]) is_visible = 1;
+      cells[j] = bar_cells;
+    }
+    int is_dirty = __atomic_exchange_n(&cprogress.is_dirty, 0, __ATOMIC_ACQUIRE);
+    frame_count += is_dirty;
+    if (is_visible && !is_dirty) {
+      fprintf(stderr, "an update to %.2f%% moved a bar without a frame\n", percentage);
+      exit(1);
+    }
+  }
+  if (frame_count > 70) {
+    fprintf(stderr, "%d frames for bars of 10 and 7 cells\n", frame_count);
+    exit(1);
+  }
+  cprogress_destroy(&cprogress);
+}
+
+void stress_slots() {
+  cprogress_t cprogress = cprogress_create("$=t $p%", 1);
+  for (int i = 0; i < CPROGRESS_TASKPAGE_BASELENGTH; ++i) cprogress_task_acquire(&cprogress);
+
+  /* the second page fails, then the slot it would have held comes next */
+  stress_malloc_isfailing = 1;
+  cprogress_taskhandle_t failed = cprogress_task_acquire(&cprogress);
+  stress_malloc_isfailing = 0;
+  cprogress_taskhandle_t task = cprogress_task_acquire(&cprogress);
+  if (cprogress_task_isvalid(failed) || task.index != 1 + CPROGRESS_TASKPAGE_BASELENGTH) {
+    fprintf(stderr, "a failed acquire left a slot behind, got task %d\n", task.index);
+    exit(1);
+  }
+
+  /* by index, fixed or acquired */
+  cprogress_taskstats_t stats;
+  cprogress_taskinfo_t *taskinfo = cprogress_findtaskinfo(&cprogress, task.index);
+  if (!taskinfo || cprogress_taskinfo_getindex(taskinfo) != task.index ||
+    cprogress_findtaskinfo(&cprogress, 0) != &cprogress_gettaskinfo(&cprogress, 0) ||
+    cprogress_findtaskinfo(&cprogress, task.index + 1) || cprogress_findtaskinfo(&cprogress, -1) ||
+    cprogress_gettaskstats(&cprogress, task.index, &stats) == CPROGRESS_ERROR_INVAL) {
+    fprintf(stderr, "task %d can't be found by index\n", task.index);
+    exit(1);
+  }
+  cprogress_destroy(&cprogress);
+}
+
+void stress_share() {
+  char name[64];
+  snprintf(name, sizeof(name), "cprogress-stress-%d", (int) getpid());
+
+  cprogress_t owner = cprogress_create("$=t $p%", 3);
+  cprogress_t intruder = cprogress_create("$=t $p%", 1);
+  if (cprogress_share(&owner, name)) {
+    /* no shared memory in this sandbox, nothing to check */
+    cprogress_destroy(&intruder);
+    cprogress_destroy(&owner);
+    return;
+  }
+  if (cprogress_share(&intruder, name) != CPROGRESS_ERROR_INVAL || owner.shared->task_count != 3) {
+    fprintf(stderr, "share took over the region of a live job\n");
+    exit(1);
+  }
+  cprogress_destroy(&intruder);
+  cprogress_destroy(&owner);
+
+  /* a child shares, then dies without unsharing */
+  pid_t pid = fork();
+  if (!pid) {
+    cprogress_t child = cprogress_create("$=t $p%", 3);
+    _exit(cprogress_share(&child, name)? 1: 0);
+  }
+  int status = 1;
+  waitpid(pid, &status, 0);
+  cprogress_t heir = cprogress_create("$=t $p%", 1);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) || cprogress_share(&heir, name) || heir.shared->task_count != 1) {
+    fprintf(stderr, "share didn't take over the region of a dead job\n");
+    exit(1);
+  }
+  cprogress_destroy(&heir);
+
+  /* a child dies right after creating the region, before it even has a size */
+  char shm_name[72];
+  snprintf(shm_name, sizeof(shm_name), "/%s", name);
+  int fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "share didn't unlink its region\n");
+    exit(1);
+  }
+  heir = cprogress_create("$=t $p%", 1);
+  if (cprogress_share(&heir, name) != CPROGRESS_ERROR_INVAL) {
+    fprintf(stderr, "share took over a region being created\n");
+    exit(1);
+  }
+  struct timespec times[2] = { { time(NULL) - CPROGRESS_SHARED_GRACE, 0 }, { time(NULL) - CPROGRESS_SHARED_GRACE, 0 } };
+  futimens(fd, times);
+  close(fd);
+  if (cprogress_share(&heir, name)) {
+    fprintf(stderr, "share didn't take over a region left empty\n");
+    exit(1);
+  }
+  cprogress_destroy(&heir);
+
+  /* or once it's sized, with its pid in and no magic yet */
+  pid = fork();
+  if (!pid) {
+    fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(cprogress_shared_t))) _exit(1);
+    cprogress_shared_t *shared = (cprogress_shared_t *) mmap(NULL, sizeof(cprogress_shared_t),
+      PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shared == MAP_FAILED) _exit(1);
+    shared->owner_pid = (int32_t) getpid();
+    _exit(0);
+  }
+  status = 1;
+  waitpid(pid, &status, 0);
+  heir = cprogress_create("$=t $p%", 1);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) || cprogress_share(&heir, name)) {
+    fprintf(stderr, "share didn't take over the region of a job dead while sharing\n");
+    exit(1);
+  }
+  cprogress_destroy(&heir);
+}
+
+
+int main(int argc, char **argv) {
+  int max_thread_count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  double duration = 1;
+  int task_count = 64;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:d:n:")) != -1) {
+    switch (opt) {
+      case 't': max_thread_count = atoi(optarg); break;
+      case 'd': duration = atof(optarg); break;
+      case 'n': task_count = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-t MAX_THREADS] [-d SECONDS] [-n TASKS]\n", argv[0]);
+        return 2;
+    }
+  }
+  if (max_thread_count < 1) max_thread_count = 1;
+  if (task_count < 1) task_count = 1;
+
+  /* results go to stderr, frames go nowhere */
+  fflush(stdout);
+  int null_fd = open("/dev/null", O_WRONLY);
+  dup2(null_fd, STDOUT_FILENO);
+  close(null_fd);
+
+  fprintf(stderr, "%7s %12s %8s %8s %8s %8s %10s %10s %10s %10s\n",
+    "threads", "M updates/s", "p50 ns", "p99 ns", "p999 ns",
+    "frames", "p50 us", "p99 us", "p999 us", "events");
+
+  for (int thread_count = 1; ; thread_count *= 2) {
+    if (thread_count > max_thread_count) thread_count = max_thread_count;
+    stress_run(thread_count, task_count, duration);
+    stress_parallel(thread_count);
+    stress_parallel_report(thread_count);
+    stress_overflow(thread_count);
+    if (thread_count >= max_thread_count) break;
+  }
+  stress_overflow_self();
+  stress_log_self();
+  stress_io();
+  stress_visible();
+  stress_collapse();
+  stress_display();
+  stress_conversion();
+  stress_history();
+  stress_styles();
+#ifdef CPROGRESS_CONFIG_STATS
+  stress_stats();
+#endif
+  stress_slots();
+  stress_share();
+
+  return 0;
+}
@@ -34,6 +34,12 @@ void print_displaychunks(cprogress_t *cprogress) {
       case CPROGRESS_DISPLAYCHUNK_PERCENTAGE:
         puts("type: percentage");
         break;
+      case CPROGRESS_DISPLAYCHUNK_SPARKLINE:
+        puts("type: sparkline");
+        break;
+      case CPROGRESS_DISPLAYCHUNK_CUSTOM:
+        puts("type: custom");
+        break;
     }
 
     if (displaychunk->is_autospan) {
@@ -0,0 +1,259 @@
+#include "stdio.h"
+#include "string.h"
+
+#include <list>
+#include <vector>
+
+#include "../cprogress.hpp"
+
+
+#define check(cond) \
+  if (!(cond)) { printf("failed at line %d: %s\n", __LINE__, #cond); return 1; }
+
+
+cprogress_taskinfo_t *find_taskinfo(cprogress_t *cprogress, int task_index) {
+  cprogress_taskinfo_foreach(cprogress, taskinfo) {
+    if (cprogress_taskinfo_getindex(taskinfo) == task_index) return taskinfo;
+  }
+  return nullptr;
+}
+
+
+
+/* test instance */
+
+
+int test_instance() {
+  cprogress::instance progress("$=t [$40b#] $p%", 2);
+  check(progress);
+  cprogress_t *cprogress = progress.get();
+
+  /* moving keeps the same cprogress_t */
+  cprogress::instance moved(std::move(progress));
+  check(!progress);
+  check(progress.get() == nullptr);
+  check(moved.get() == cprogress);
+
+  progress = std::move(moved);
+  check(progress.get() == cprogress);
+
+  cprogress::instance invalid("$b", 1);
+  check(!invalid);
+  check(invalid.error() != CPROGRESS_ERROR_OK);
+
+  return 0;
+}
+
+
+
+/* test task guard */
+
+
+int test_taskguard() {
+  cprogress::instance progress("$=t [$40b#] $p%", 2);
+  check(progress);
+  cprogress_t *cprogress = progress.get();
+
+  /* titles need no terminating NUL */
+  std::string_view line = "Copying files, 3 left";
+  {
+    cprogress::task_guard task(progress, 1);
+    check(cprogress_taskinfo_isrunning(&cprogress_gettaskinfo(cprogress, 1)));
+    task.update_title(line.substr(0, 7));
+    check(strcmp(cprogress_gettaskinfo(cprogress, 1).title, "Copying") == 0);
+    task.update_percentage(40);
+  }
+  check(cprogress_taskinfo_getstate(&cprogress_gettaskinfo(cprogress, 1)) == CPROGRESS_TASK_FINISHING);
+  check(cprogress_gettaskinfo(cprogress, 1).percentage == 100);
+
+  /* acquired, finished once even if moved */
+  int task_index;
+  {
+    cprogress::task_guard task(progress);
+    check(task);
+    task_index = task.index();
+    check(task_index >= 2);
+    task.add_percentage(10);
+
+    cprogress::task_guard moved(std::move(task));
+    check(!task);
+    check(moved.index() == task_index);
+    check(cprogress_taskinfo_isrunning(find_taskinfo(cprogress, task_index)));
+  }
+  check(cprogress_taskinfo_getstate(find_taskinfo(cprogress, task_index)) == CPROGRESS_TASK_FINISHING);
+
+  /* aborted ones stay aborted */
+  {
+    cprogress::task_guard task(progress, 0);
+    task.abort();
+  }
+  check(cprogress_gettaskinfo(cprogress, 0).percentage < 100);
+
+  cprogress_beginrender_consolewidth(cprogress, 80);
+  cprogress_render(cprogress);
+  cprogress_endrender(cprogress);
+  check(cprogress_taskinfo_getstate(&cprogress_gettaskinfo(cprogress, 0)) == CPROGRESS_TASK_ABORTED);
+  check(cprogress_taskinfo_getstate(&cprogress_gettaskinfo(cprogress, 1)) == CPROGRESS_TASK_DONE);
+
+  return 0;
+}
+
+
+
+/* test track */
+
+
+int test_track() {
+  cprogress::instance progress("$=t [$40b#] $p%", 3);
+  check(progress);
+  cprogress_t *cprogress = progress.get();
+
+  /* every element seen, in order, finished by the last one */
+  std::vector<int> items(25000);
+  for (size_t i = 0; i < items.size(); ++i) items[i] = (int) i;
+  progress.start_task(0);
+  long sum = 0;
+  int expected = 0;
+  for (int &item : cprogress::track(progress, 0, items)) {
+    check(item == expected++);
+    sum += item;
+    /* a step behind at most */
+    float percentage = cprogress_gettaskinfo(cprogress, 0).percentage;
+    check(percentage <= 100.0f * item / items.size());
+    long step = (long) (items.size() / cprogress::track_steps);
+    check(percentage >= 100.0f * (item - 2 * step) / items.size() - 0.01f);
+  }
+  check(expected == 25000);
+  check(sum == 25000L * 24999 / 2);
+  check(cprogress_taskinfo_getstate(&cprogress_gettaskinfo(cprogress, 0)) == CPROGRESS_TASK_FINISHING);
+
+  /* a given stride, over something not random access, left where it broke */
+  std::list<int> list(10, 1);
+  progress.start_task(1);
+  int count = 0;
+  for (int item : cprogress::track(cprogress, 1, list, 3)) {
+    if (++count > 7) break;
+    (void) item;
+  }
+  check(cprogress_gettaskinfo(cprogress, 1).percentage == 60);
+  check(cprogress_taskinfo_isrunning(&cprogress_gettaskinfo(cprogress, 1)));
+
+  /* nothing to go through is done already */
+  progress.start_task(2);
+  for (int item : cprogress::track(progress, 2, std::vector<int>())) (void) item;
+  check(cprogress_taskinfo_getstate(&cprogress_gettaskinfo(cprogress, 2)) == CPROGRESS_TASK_FINISHING);
+
+  return 0;
+}
+
+
+
+/* test coroutines */
+
+
+#ifdef CPROGRESS_HPP_COROUTINES
+
+/* resumes in deadline order, without waiting for them */
+struct test_scheduler {
+  std::vector<std::pair<int64_t, std::coroutine_handle<>>> queue;
+
+  void schedule_at(std::coroutine_handle<> handle, int64_t deadline) {
+    queue.emplace_back(deadline, handle);
+  }
+
+  void run() {
+    while (!queue.empty()) {
+      auto first = queue.begin();
+      for (auto it = queue.begin(); it != queue.end(); ++it)
+        if (it->first < first->first) first = it;
+      std::coroutine_handle<> handle = first->second;
+      queue.erase(first);
+      handle.resume();
+    }
+  }
+};
+
+/* starts right away, and frees itself when done */
+struct test_coroutine {
+  struct promise_type {
+    test_coroutine get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { abort(); }
+  };
+};
+
+test_coroutine test_worker(cprogress::instance &progress, int *report_count) {
+  cprogress::task_guard task(progress);
+  while (co_await task.report(10)) ++*report_count;
+}
+
+test_coroutine test_aborted(cprogress::instance &progress, int *report_count) {
+  cprogress::task_guard task(progress, 0);
+  task.abort();
+  while (co_await task.report(10)) ++*report_count;
+}
+
+test_coroutine test_renderer(cprogress::instance &progress, test_scheduler &scheduler, int *frame_count) {
+  while (progress.still_running()) {
+    co_await progress.next_frame(scheduler, 1000);
+    ++*frame_count;
+  }
+}
+
+/* no fps, or no instance, still comes back a frame later */
+test_coroutine test_nextframe(cprogress_t *cprogress, test_scheduler &scheduler, int fps, int *frame_count) {
+  co_await cprogress::frame_awaitable<test_scheduler>(cprogress, scheduler, fps);
+  ++*frame_count;
+}
+
+int test_coroutines() {
+  cprogress::instance progress("$=t [$40b#] $p%", 1);
+  check(progress);
+
+  /* ten reports bring each to 100%, the last one is false */
+  int report_count = 0;
+  for (int i = 0; i < 100; ++i) test_worker(progress, &report_count);
+  check(report_count == 100 * 9);
+
+  int aborted_report_count = 0;
+  test_aborted(progress, &aborted_report_count);
+  check(aborted_report_count == 0);
+
+  test_scheduler scheduler;
+  int frame_count = 0;
+  test_renderer(progress, scheduler, &frame_count);
+  scheduler.run();
+  check(frame_count >= 1);
+  check(!progress.still_running());
+
+  int nextframe_count = 0;
+  test_nextframe(progress.get(), scheduler, 0, &nextframe_count);
+  test_nextframe(progress.get(), scheduler, -30, &nextframe_count);
+  test_nextframe(nullptr, scheduler, 30, &nextframe_count);
+  check(scheduler.queue.size() == 3);
+  for (auto &entry : scheduler.queue) check(entry.first > 0);
+  scheduler.run();
+  check(nextframe_count == 3);
+
+  return 0;
+}
+
+#endif /* CPROGRESS_HPP_COROUTINES */
+
+
+
+/* switcher */
+
+
+int main(void) {
+  if (test_instance()) return 1;
+  if (test_taskguard()) return 1;
+  if (test_track()) return 1;
+#ifdef CPROGRESS_HPP_COROUTINES
+  if (test_coroutines()) return 1;
+#endif
+  puts("");
+  return 0;
+}
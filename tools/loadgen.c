@@ -0,0 +1,184 @@
+/*
+  cprogress-loadgen - measure how fast progress can be ingested
+
+  | cprogress-loadgen [-s PATH] [-n COUNT] [-c CLIENTS] [-t TASKS]
+
+  Without -s, it serves an instance of its own and reports how many updates
+  per second it applied, along with the cpu time the serving thread spent.
+  With -s, it only acts as a reporter to the socket at PATH.
+*/
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+#include "unistd.h"
+#include "pthread.h"
+#include "sys/socket.h"
+#include "sys/un.h"
+
+#include "cprogress.h"
+
+
+#define LOADGEN_BATCHSIZE 65536
+
+
+typedef struct {
+  const char *path;
+  long count;
+  int task_count;
+  int client_index;
+} loadgen_client_t;
+
+
+double loadgen_gettime(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int loadgen_connect(const char *path) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  /* the server may still be starting */
+  for (int retry = 0; retry < 100; ++retry) {
+    if (!connect(fd, (struct sockaddr *) &addr, sizeof(addr))) return fd;
+    usleep(10000);
+  }
+  close(fd);
+  return -1;
+}
+
+void *loadgen_client(void *userdata) {
+  loadgen_client_t *client = (loadgen_client_t *) userdata;
+
+  int fd = loadgen_connect(client->path);
+  if (fd < 0) {
+    perror("cprogress-loadgen: connect");
+    return NULL;
+  }
+
+  /* render one batch of lines up front, so the reporter costs next to
+    nothing compared to the server */
+  char *batch = (char *) malloc(LOADGEN_BATCHSIZE);
+  size_t line_ends[LOADGEN_BATCHSIZE / 4];
+  size_t line_count = 0;
+  size_t batch_len = 0;
+  for (long i = 0; batch_len + 32 < LOADGEN_BATCHSIZE; ++i) {
+    int task_index = (int) ((i + client->client_index) % client->task_count);
+    if (i % 4 == 3)
+      batch_len += sprintf(batch + batch_len, "%d +0.01\n", task_index);
+    else
+      batch_len += sprintf(batch + batch_len, "%d %ld.%02ld\n", task_index, i % 90, i % 100);
+    line_ends[line_count++] = batch_len;
+  }
+
+  for (long sent = 0; sent < client->count; ) {
+    size_t lines = client->count - sent < (long) line_count? (size_t) (client->count - sent): (size_t) line_count;
+    size_t len = line_ends[lines - 1];
+    for (size_t written = 0; written < len; ) {
+      ssize_t result = write(fd, batch + written, len - written);
+      if (result <= 0) {
+        perror("cprogress-loadgen: write");
+        goto done;
+      }
+      written += result;
+    }
+    sent += lines;
+  }
+
+done:
+  free(batch);
+  close(fd);
+  return NULL;
+}
+
+
+int main(int argc, char **argv) {
+  const char *path = NULL;
+  long count = 10000000;
+  int client_count = 1;
+  int task_count = 64;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:n:c:t:")) != -1) {
+    switch (opt) {
+      case 's': path = optarg; break;
+      case 'n': count = atol(optarg); break;
+      case 'c': client_count = atoi(optarg); break;
+      case 't': task_count = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-s PATH] [-n COUNT] [-c CLIENTS] [-t TASKS]\n", argv[0]);
+        return 2;
+    }
+  }
+  if (count <= 0 || client_count <= 0 || task_count <= 0) {
+    fprintf(stderr, "cprogress-loadgen: counts should be positive\n");
+    return 2;
+  }
+
+  char server_path[64];
+  cprogress_t cprogress = {};
+  if (!path) {
+    snprintf(server_path, sizeof(server_path), "/tmp/cprogress-loadgen-%d.sock", (int) getpid());
+    path = server_path;
+
+    cprogress = cprogress_create("$=t [$40b#] $p%", task_count);
+    if (cprogress.error || cprogress_ingest_listen(&cprogress, path)) {
+      fprintf(stderr, "cprogress-loadgen: failed to listen on %s\n", path);
+      return 1;
+    }
+    cprogress_startalltasks(&cprogress);
+  }
+
+  loadgen_client_t *clients = (loadgen_client_t *) calloc(client_count, sizeof(loadgen_client_t));
+  pthread_t *threads = (pthread_t *) calloc(client_count, sizeof(pthread_t));
+  for (int i = 0; i < client_count; ++i) {
+    clients[i] = (loadgen_client_t) {
+      .path = path,
+      .count = count / client_count + (i < count % client_count),
+      .task_count = task_count,
+      .client_index = i,
+    };
+  }
+
+  double begin = loadgen_gettime(CLOCK_MONOTONIC);
+  for (int i = 0; i < client_count; ++i)
+    pthread_create(&threads[i], NULL, loadgen_client, &clients[i]);
+
+  double server_cputime = 0;
+  if (cprogress.ingest) {
+    double cputime_begin = loadgen_gettime(CLOCK_THREAD_CPUTIME_ID);
+    cprogress_ingest_t *ingest = cprogress.ingest;
+    while (ingest->applied_count + ingest->rejected_count < (uint64_t) count) {
+      if (cprogress_ingest_poll(&cprogress, 100) < 0) break;
+    }
+    server_cputime = loadgen_gettime(CLOCK_THREAD_CPUTIME_ID) - cputime_begin;
+  }
+
+  for (int i = 0; i < client_count; ++i)
+    pthread_join(threads[i], NULL);
+  double elapsed = loadgen_gettime(CLOCK_MONOTONIC) - begin;
+
+  if (cprogress.ingest) {
+    uint64_t applied = cprogress.ingest->applied_count;
+    printf("applied %llu updates (%llu rejected) from %d client(s) in %.3fs\n",
+      (unsigned long long) applied, (unsigned long long) cprogress.ingest->rejected_count,
+      client_count, elapsed);
+    printf("wall: %.2f M updates/s, %.1f ns/update\n",
+      applied / elapsed / 1e6, elapsed * 1e9 / applied);
+    printf("server cpu: %.3fs, %.2f M updates/s/core\n",
+      server_cputime, applied / server_cputime / 1e6);
+    cprogress_destroy(&cprogress);
+  } else {
+    printf("sent %ld updates from %d client(s) in %.3fs, %.2f M updates/s\n",
+      count, client_count, elapsed, count / elapsed / 1e6);
+  }
+
+  free(threads);
+  free(clients);
+  return 0;
+}
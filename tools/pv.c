@@ -0,0 +1,343 @@
+/*
+  cprogress-pv - watch bytes go through a pipe
+
+  | cprogress-pv [-q] [-r] [-f FPS] [-d DIR] [FILE...]
+
+  Copies the FILEs, or stdin, to stdout one after another, like cat(1),
+  with a row per input showing how much went through, how fast, and how
+  long is left, plus a total row. Rows go to stderr. With -d, each FILE is
+  copied into DIR instead, all at the same time.
+
+  Bytes are moved by cprogress_copy_fd, so they stay in the kernel whenever
+  it can. -q draws nothing and -r prints the throughput at the end, so the
+  two together tell what drawing costs.
+*/
+
+#include "stdio.h"
+#include "stdint.h"
+#include "stdlib.h"
+#include "string.h"
+#include "errno.h"
+#include "fcntl.h"
+#include "unistd.h"
+#include "pthread.h"
+#include "sys/stat.h"
+
+#include "cprogress.h"
+
+
+#define PV_RATE_SMOOTHING 0.25 /* weight of the newest frame */
+
+
+typedef struct {
+  const char *path; /* NULL for stdin */
+  int in_fd;
+  int out_fd;
+  int64_t size; /* -1 when not known ahead */
+  int64_t done; /* by its worker */
+} pv_input_t;
+
+/* what a row shows, one per input and the total last */
+typedef struct {
+  int64_t done;
+  int64_t size;
+  double rate; /* bytes per second */
+} pv_row_t;
+
+typedef struct {
+  cprogress_t cprogress;
+  pv_input_t *inputs;
+  int input_count;
+  pv_row_t *rows;
+  int row_count;
+  int is_quiet;
+} pv_t;
+
+typedef struct {
+  pv_t *pv;
+  int first; /* inputs [first, last) in order */
+  int last;
+  int64_t end_ns; /* when it was through, drawing the last frame aside */
+} pv_worker_t;
+
+
+int64_t pv_gettime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void pv_log(pv_t *pv, const char *path, const char *what) {
+  cprogress_log(&pv->cprogress, "cprogress-pv: %s: %s: %s", path? path: "stdin", what, strerror(errno));
+}
+
+
+/* transfer */
+
+void *pv_worker(void *userdata) {
+  pv_worker_t *worker = (pv_worker_t *) userdata;
+  pv_t *pv = worker->pv;
+
+  for (int i = worker->first; i < worker->last; ++i) {
+    pv_input_t *input = &pv->inputs[i];
+    if (input->in_fd < 0 || input->out_fd < 0) {
+      cprogress_aborttask(&pv->cprogress, i);
+      continue;
+    }
+
+    /* the row reads [done] between two updates of the task */
+    if (cprogress_copy_fdcounted(&pv->cprogress, i, input->in_fd, input->out_fd, -1, &input->done) < 0) {
+      pv_log(pv, input->path, "copy");
+      cprogress_aborttask(&pv->cprogress, i);
+    }
+  }
+  worker->end_ns = pv_gettime();
+  return NULL;
+}
+
+
+/* rows */
+
+/* once per frame, by the rendering thread only */
+void pv_updaterows(pv_t *pv, double elapsed) {
+  pv_row_t *total = &pv->rows[pv->input_count];
+  int64_t total_done = 0, total_size = 0;
+
+  for (int i = 0; i <= pv->input_count; ++i) {
+    pv_row_t *row = &pv->rows[i];
+    int64_t done;
+    if (i < pv->input_count) {
+      done = __atomic_load_n(&pv->inputs[i].done, __ATOMIC_RELAXED);
+      row->size = pv->inputs[i].size;
+      total_done += done;
+      total_size = total_size < 0 || row->size < 0? -1: total_size + row->size;
+    } else {
+      done = total_done;
+      row->size = total_size;
+    }
+
+    if (elapsed > 0) {
+      double rate = (done - row->done) / elapsed;
+      row->rate = row->rate? row->rate + (rate - row->rate) * PV_RATE_SMOOTHING: rate;
+    }
+    row->done = done;
+  }
+
+  if (pv->input_count > 1 && total->size > 0 && total->done < total->size)
+    cprogress_updatetask_percentage(&pv->cprogress, pv->input_count, 100.0f * total->done / total->size);
+}
+
+pv_row_t *pv_getrow(void *userdata, cprogress_taskinfo_t *taskinfo) {
+  pv_t *pv = (pv_t *) userdata;
+  if (!taskinfo) return NULL;
+  int index = cprogress_taskinfo_getindex(taskinfo);
+  return index >= 0 && index < pv->row_count? &pv->rows[index]: NULL;
+}
+
+size_t pv_writebytes(char *buf, size_t buf_len, size_t alloc_width, double bytes, const char *suffix) {
+  static const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB", "PiB" };
+  int unit = 0;
+  while (bytes >= 1024 && unit < (int) (sizeof(units) / sizeof(units[0])) - 1) {
+    bytes /= 1024;
+    ++unit;
+  }
+  size_t length = (size_t) snprintf(buf, buf_len, "%*.1f %s%s",
+    (int) (alloc_width - strlen(units[unit]) - strlen(suffix) - 1), bytes, units[unit], suffix);
+  return length < buf_len? length: buf_len - 1;
+}
+
+size_t pv_conversion_bytes(char *buf, size_t buf_len, size_t alloc_width,
+  cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo, void *userdata) {
+  (void) cprogress;
+  pv_row_t *row = pv_getrow(userdata, taskinfo);
+  return row? pv_writebytes(buf, buf_len, alloc_width, (double) row->done, ""): 0;
+}
+
+size_t pv_conversion_rate(char *buf, size_t buf_len, size_t alloc_width,
+  cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo, void *userdata) {
+  (void) cprogress;
+  pv_row_t *row = pv_getrow(userdata, taskinfo);
+  return row? pv_writebytes(buf, buf_len, alloc_width, row->rate, "/s"): 0;
+}
+
+size_t pv_conversion_eta(char *buf, size_t buf_len, size_t alloc_width,
+  cprogress_t *cprogress, cprogress_taskinfo_t *taskinfo, void *userdata) {
+  (void) alloc_width;
+  (void) cprogress;
+  pv_row_t *row = pv_getrow(userdata, taskinfo);
+  if (!row) return 0;
+
+  size_t length;
+  if (row->size < 0 || row->rate < 1) {
+    length = (size_t) snprintf(buf, buf_len, "--:--:--");
+  } else {
+    long seconds = (long) ((row->size > row->done? row->size - row->done: 0) / row->rate);
+    if (seconds > 99 * 3600 + 59 * 60 + 59) seconds = 99 * 3600 + 59 * 60 + 59;
+    length = (size_t) snprintf(buf, buf_len, "%02ld:%02ld:%02ld", seconds / 3600, seconds / 60 % 60, seconds % 60);
+  }
+  return length < buf_len? length: buf_len - 1;
+}
+
+
+/* inputs */
+
+int pv_open(pv_t *pv, int input_index, const char *dir, int data_fd) {
+  pv_input_t *input = &pv->inputs[input_index];
+  input->in_fd = input->path? open(input->path, O_RDONLY | O_CLOEXEC): STDIN_FILENO;
+  input->out_fd = data_fd;
+  input->size = 0; /* failed ones don't count towards the total */
+  const char *title = input->path? input->path: "stdin";
+  cprogress_updatetask_title(&pv->cprogress, input_index, title);
+  if (input->in_fd < 0) {
+    pv_log(pv, input->path, "open");
+    return -1;
+  }
+
+  struct stat in_stat;
+  input->size = -1;
+  if (!fstat(input->in_fd, &in_stat) && S_ISREG(in_stat.st_mode)) {
+    off_t offset = lseek(input->in_fd, 0, SEEK_CUR);
+    input->size = in_stat.st_size > offset && offset >= 0? in_stat.st_size - offset: 0;
+  }
+
+  if (dir) {
+    const char *name = strrchr(title, '/');
+    name = name? name + 1: title;
+    char *out_path = (char *) malloc(strlen(dir) + strlen(name) + 2);
+    sprintf(out_path, "%s/%s", dir, name);
+    input->out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (input->out_fd < 0) pv_log(pv, out_path, "open");
+    free(out_path);
+    if (input->out_fd < 0) return -1;
+  }
+  return 0;
+}
+
+
+int main(int argc, char **argv) {
+  int fps = 10;
+  int is_reporting = 0;
+  const char *dir = NULL;
+  pv_t pv = {};
+
+  int opt;
+  while ((opt = getopt(argc, argv, "qrf:d:")) != -1) {
+    switch (opt) {
+      case 'q': pv.is_quiet = 1; break;
+      case 'r': is_reporting = 1; break;
+      case 'f': fps = atoi(optarg); break;
+      case 'd': dir = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-q] [-r] [-f FPS] [-d DIR] [FILE...]\n", argv[0]);
+        return 2;
+    }
+  }
+  if (fps <= 0) fps = 10;
+  if (dir && optind >= argc) {
+    fprintf(stderr, "cprogress-pv: -d needs FILEs\n");
+    return 2;
+  }
+
+  /* frames are drawn to stdout, so stdout is stderr from now on, and the
+    data keeps the real one under another fd */
+  int data_fd = dup(STDOUT_FILENO);
+  if (data_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+    perror("cprogress-pv: dup");
+    return 1;
+  }
+
+  /* stdin without FILEs */
+  int input_count = argc - optind;
+  if (input_count < 1) input_count = 1;
+  pv.input_count = input_count;
+  pv.row_count = pv.input_count + 1;
+  pv.inputs = (pv_input_t *) calloc((size_t) pv.input_count, sizeof(pv_input_t));
+  pv.rows = (pv_row_t *) calloc((size_t) pv.input_count + 1, sizeof(pv_row_t));
+  for (int i = 0; i < pv.input_count; ++i) {
+    const char *path = optind < argc? argv[optind + i]: NULL;
+    pv.inputs[i].path = path && strcmp(path, "-")? path: NULL;
+  }
+
+  cprogress_registerconversion('B', pv_conversion_bytes, &pv, CPROGRESS_CONVERSION_FIXEDWIDTH, 10);
+  cprogress_registerconversion('R', pv_conversion_rate, &pv, CPROGRESS_CONVERSION_FIXEDWIDTH, 12);
+  cprogress_registerconversion('E', pv_conversion_eta, &pv, CPROGRESS_CONVERSION_FIXEDWIDTH, 8);
+
+  /* a total row only when there's more than one */
+  pv.cprogress = cprogress_create("$=t $B $R $E [$24b#] $p%", pv.input_count > 1? pv.row_count: 1);
+  if (pv.cprogress.error) {
+    fprintf(stderr, "cprogress-pv: failed to create the rows (error %d)\n", pv.cprogress.error);
+    return 1;
+  }
+  if (!pv.is_quiet) cprogress_openlog(&pv.cprogress, 0, CPROGRESS_LOG_BLOCK);
+  cprogress_startalltasks(&pv.cprogress);
+  if (pv.input_count > 1) cprogress_updatetask_title(&pv.cprogress, pv.input_count, "total");
+
+  int failed_count = 0;
+  for (int i = 0; i < pv.input_count; ++i)
+    failed_count += pv_open(&pv, i, dir, data_fd) < 0;
+
+  /* one after another onto stdout, or each on its own into DIR */
+  int worker_count = dir? input_count: 1;
+  pv_worker_t *workers = (pv_worker_t *) calloc(worker_count, sizeof(pv_worker_t));
+  pthread_t *threads = (pthread_t *) calloc(worker_count, sizeof(pthread_t));
+  int64_t begin = pv_gettime();
+  for (int i = 0; i < worker_count; ++i) {
+    workers[i] = (pv_worker_t) { &pv, dir? i: 0, dir? i + 1: pv.input_count, 0 };
+    pthread_create(&threads[i], NULL, pv_worker, &workers[i]);
+  }
+
+  if (!pv.is_quiet) {
+    int64_t last = begin;
+    int is_total_done = pv.input_count <= 1;
+    while (cprogress_stillrunning(&pv.cprogress)) {
+      int64_t now = pv_gettime();
+      pv_updaterows(&pv, (now - last) / 1e9);
+      last = now;
+
+      /* the total is done once the rest are */
+      if (!is_total_done) {
+        int is_any_running = 0;
+        for (int i = 0; i < pv.input_count; ++i)
+          is_any_running |= cprogress_taskinfo_isrunning(&cprogress_gettaskinfo(&pv.cprogress, i));
+        if (!is_any_running) {
+          cprogress_updatetask_percentage(&pv.cprogress, pv.input_count, 100);
+          is_total_done = 1;
+        }
+      }
+
+      cprogress_beginrender(&pv.cprogress);
+      cprogress_render(&pv.cprogress);
+      cprogress_endrender(&pv.cprogress);
+      cprogress_waitfps(&pv.cprogress, fps);
+    }
+  }
+
+  int64_t end = begin;
+  for (int i = 0; i < worker_count; ++i) {
+    pthread_join(threads[i], NULL);
+    if (workers[i].end_ns > end) end = workers[i].end_ns;
+  }
+  double elapsed = (end - begin) / 1e9;
+
+  int64_t total_done = 0;
+  for (int i = 0; i < pv.input_count; ++i) {
+    pv_input_t *input = &pv.inputs[i];
+    total_done += input->done;
+    if (input->in_fd > STDIN_FILENO) close(input->in_fd);
+    if (dir && input->out_fd >= 0) close(input->out_fd);
+    failed_count += cprogress_taskinfo_getstate(&cprogress_gettaskinfo(&pv.cprogress, i)) == CPROGRESS_TASK_ABORTED;
+  }
+  cprogress_destroy(&pv.cprogress);
+
+  if (is_reporting) {
+    fprintf(stderr, "cprogress-pv: %lld bytes in %.3fs, %.1f MiB/s\n",
+      (long long) total_done, elapsed, elapsed > 0? total_done / elapsed / (1 << 20): 0);
+  }
+
+  free(threads);
+  free(workers);
+  free(pv.rows);
+  free(pv.inputs);
+  close(data_fd);
+  return failed_count? 1: 0;
+}
@@ -0,0 +1,70 @@
+/*
+  cprogress-top - watch the progress of another process
+
+  | cprogress-top NAME [FPS]
+
+  Attaches read-only to the region a job created with cprogress_share(...)
+  and renders it here, until the job finishes or Ctrl-C is pressed.
+*/
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "signal.h"
+
+#include "cprogress.h"
+
+
+static volatile sig_atomic_t top_is_interrupted = 0;
+
+void top_oninterrupt(int signum) {
+  (void) signum;
+  top_is_interrupted = 1;
+}
+
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s NAME [FPS]\n", argv[0]);
+    return 2;
+  }
+
+  int fps = argc > 2? atoi(argv[2]): 10;
+  if (fps <= 0) fps = 10;
+
+  size_t shared_size = 0;
+  const cprogress_shared_t *shared = cprogress_share_attach(argv[1], &shared_size);
+  if (!shared) {
+    fprintf(stderr, "cprogress-top: nothing is shared as \"%s\"\n", argv[1]);
+    return 1;
+  }
+
+  cprogress_t cprogress = cprogress_create(shared->fmt, shared->task_count);
+  if (cprogress.error) {
+    fprintf(stderr, "cprogress-top: bad format \"%s\" (error %d)\n", shared->fmt, cprogress.error);
+    cprogress_share_detach(shared, shared_size);
+    return 1;
+  }
+
+  signal(SIGINT, top_oninterrupt);
+  signal(SIGTERM, top_oninterrupt);
+
+  int is_owner_alive = 1;
+  while (is_owner_alive && !top_is_interrupted) {
+    is_owner_alive = cprogress_share_read(shared, &cprogress);
+
+    cprogress_beginrender(&cprogress);
+    cprogress_render(&cprogress);
+    cprogress_endrender(&cprogress);
+
+    if (is_owner_alive) cprogress_waitfps(&cprogress, fps);
+  }
+
+  /* step below the bars before leaving */
+  cprogress_abort(&cprogress);
+  cprogress_stillrunning(&cprogress);
+
+  cprogress_destroy(&cprogress);
+  cprogress_share_detach(shared, shared_size);
+
+  return 0;
+}